@@ -33,6 +33,7 @@
 #include <math.h>
 #include <signal.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -236,39 +237,95 @@ LineReader ReadLinesFromPipe(const std::string& cmd) {
   return LineReader(pipe, true);
 }
 
+extern "C" char* __cxa_demangle(const char* mangled_name, char* buf, size_t* n,
+                                int* status);
+
 namespace {
 
-std::string DemangleRustSymbol(std::string_view mangled) {
-  constexpr size_t kBufferSize = 8192;
-  std::unique_ptr<std::array<char, kBufferSize>> buffer =
-      std::make_unique<std::array<char, kBufferSize>>();
-  int result = rustc_demangle(mangled.data(), buffer->data(), kBufferSize);
-  if (result == 1) {
-    return std::string(buffer->data());
+// Per-thread storage for the demangler, reused across calls so that demangling
+// a symbol doesn't allocate once the buffers have grown to fit.
+struct DemangleScratch {
+  DemangleScratch()
+      : full(static_cast<char*>(malloc(kInitialFullSize))),
+        full_size(kInitialFullSize) {}
+  ~DemangleScratch() { free(full); }
+
+  static constexpr size_t kInitialFullSize = 4096;
+
+  // NUL-terminated copy of the name being demangled.
+  std::string input;
+  char rust[8192];
+  char itanium_short[4096];
+  // Allocated with malloc(), since __cxa_demangle() may realloc() it.
+  char* full;
+  size_t full_size;
+};
+
+DemangleScratch* GetDemangleScratch() {
+  thread_local DemangleScratch scratch;
+  return &scratch;
+}
+
+// Writes |prefix| followed by the demangled Rust symbol into the scratch
+// buffer.  Returns an empty view if |mangled| could not be demangled.
+string_view DemangleRustSymbol(const char* mangled, string_view prefix,
+                               DemangleScratch* scratch) {
+  char* buf = scratch->rust;
+  memcpy(buf, prefix.data(), prefix.size());
+  int result = rustc_demangle(mangled, buf + prefix.size(),
+                              sizeof(scratch->rust) - prefix.size());
+  if (result == 1 && buf[prefix.size()] != '\0') {
+    return string_view(buf, prefix.size() + strlen(buf + prefix.size()));
   } else {
-    return "";
+    return string_view();
   }
 }
 
-}  // namespace
+bool DemangleItanium(const char* mangled, DataSource source,
+                     DemangleScratch* scratch, string_view* demangled) {
+  if (source == DataSource::kShortSymbols) {
+    if (::Demangle(mangled, scratch->itanium_short,
+                   sizeof(scratch->itanium_short))) {
+      *demangled = scratch->itanium_short;
+      return true;
+    }
+  } else {
+    int status;
+    char* ret =
+        __cxa_demangle(mangled, scratch->full, &scratch->full_size, &status);
+    if (ret) {
+      // On success the buffer may have been reallocated.
+      scratch->full = ret;
+      *demangled = ret;
+      return true;
+    }
+  }
+  return false;
+}
 
-extern "C" char* __cxa_demangle(const char* mangled_name, char* buf, size_t* n,
-                                int* status);
+}  // namespace
 
-std::string ItaniumDemangle(string_view symbol, DataSource source) {
+string_view ItaniumDemangleView(string_view symbol, DataSource source) {
   if (source == DataSource::kRawSymbols) {
     // No demangling.
-    return std::string(symbol);
+    return symbol;
+  } else if (source != DataSource::kShortSymbols &&
+             source != DataSource::kFullSymbols) {
+    printf("Unexpected source: %d\n", (int)source);
+    BLOATY_UNREACHABLE();
   }
 
+  DemangleScratch* scratch = GetDemangleScratch();
   string_view demangle_from = symbol;
   if (absl::StartsWith(demangle_from, "__Z")) {
     demangle_from.remove_prefix(1);
   }
+  scratch->input.assign(demangle_from.data(), demangle_from.size());
+  size_t offset = 0;
 
   if (absl::StartsWith(demangle_from, "_R")) {
     // Demangle Rust symbols
-    std::string ret = DemangleRustSymbol(demangle_from);
+    string_view ret = DemangleRustSymbol(scratch->input.c_str(), "", scratch);
     if (!ret.empty()) {
       return ret;
     }
@@ -277,66 +334,191 @@ std::string ItaniumDemangle(string_view symbol, DataSource source) {
   if (absl::StartsWith(demangle_from, "switch.table._R")) {
     // Demangle Rust symbols for switch tables
     demangle_from.remove_prefix(13);
-    std::string ret = DemangleRustSymbol(demangle_from);
+    offset += 13;
+    string_view ret = DemangleRustSymbol(scratch->input.c_str() + offset,
+                                         "switch.table.", scratch);
     if (!ret.empty()) {
-      return "switch.table." + ret;
+      return ret;
     }
   }
 
   if (absl::StartsWith(demangle_from, ".Lswitch.table._R")) {
     // Demangle Rust symbols for switch tables, with ".L" prefix.
     demangle_from.remove_prefix(15);
-    std::string ret = DemangleRustSymbol(demangle_from);
+    offset += 15;
+    string_view ret = DemangleRustSymbol(scratch->input.c_str() + offset,
+                                         "switch.table.", scratch);
     if (!ret.empty()) {
-      return "switch.table." + ret;
+      return ret;
     }
   }
 
-  if (source == DataSource::kShortSymbols) {
-    char demangled[4096];
-    if (::Demangle(demangle_from.data(), demangled, sizeof(demangled))) {
-      return std::string(demangled);
-    } else {
-      // TODO(yifeit): Certain symbols have dots (".") in them. Those are not allowed.
-      // Find and remove the last "." and anything after.
-      auto pos = demangle_from.find(".");
-      if (pos != absl::string_view::npos) {
-        demangle_from.remove_suffix(demangle_from.length() - pos);
-        std::string shortened(demangle_from);
-        if (::Demangle(shortened.c_str(), demangled, sizeof(demangled))) {
-          return std::string(demangled);
-        }
-      }
-      return std::string(symbol);
-    }
-  } else if (source == DataSource::kFullSymbols) {
-    char* demangled =
-        __cxa_demangle(demangle_from.data(), NULL, NULL, NULL);
-    if (demangled) {
-      std::string ret(demangled);
-      free(demangled);
+  string_view ret;
+  if (DemangleItanium(scratch->input.c_str() + offset, source, scratch,
+                      &ret)) {
+    return ret;
+  }
+
+  // TODO(yifeit): Certain symbols have dots (".") in them. Those are not allowed.
+  // Find and remove the last "." and anything after.
+  auto pos = scratch->input.find('.', offset);
+  if (pos != std::string::npos) {
+    scratch->input.resize(pos);
+    if (DemangleItanium(scratch->input.c_str() + offset, source, scratch,
+                        &ret)) {
       return ret;
+    }
+  }
+  return symbol;
+}
+
+namespace {
+
+// Copies strings into large blocks that are freed all at once, so that storing
+// many short strings costs neither a heap allocation nor a std::string header
+// apiece.
+class StringArena {
+ public:
+  string_view Copy(string_view str) {
+    if (str.empty()) {
+      return string_view();
+    }
+    char* dest;
+    if (str.size() > kBlockSize / 4) {
+      blocks_.emplace_back(new char[str.size()]);
+      dest = blocks_.back().get();
     } else {
-      // TODO(yifeit): Certain symbols have dots (".") in them. Those are not allowed.
-      // Find and remove the last "." and anything after.
-      auto pos = demangle_from.find(".");
-      if (pos != absl::string_view::npos) {
-        demangle_from.remove_suffix(demangle_from.length() - pos);
-        std::string shortened(demangle_from);
-        char* demangled =
-            __cxa_demangle(shortened.c_str(), NULL, NULL, NULL);
-        if (demangled) {
-          std::string ret(demangled);
-          free(demangled);
-          return ret;
-        }
+      if (remaining_ < str.size()) {
+        blocks_.emplace_back(new char[kBlockSize]);
+        ptr_ = blocks_.back().get();
+        remaining_ = kBlockSize;
       }
-      return std::string(symbol);
+      dest = ptr_;
+      ptr_ += str.size();
+      remaining_ -= str.size();
     }
-  } else {
-    printf("Unexpected source: %d\n", (int)source);
-    BLOATY_UNREACHABLE();
+    memcpy(dest, str.data(), str.size());
+    return string_view(dest, str.size());
+  }
+
+ private:
+  static constexpr size_t kBlockSize = 64 * 1024;
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char* ptr_ = nullptr;
+  size_t remaining_ = 0;
+};
+
+// A process-wide cache of demangled names, keyed by (mangled name, source).
+// The same name is demangled many times: by the symbols data source, by the
+// link map readers, and again for every input file that contains the same
+// inline function or template instantiation.
+//
+// The cache is sharded by hash so that threads scanning different files
+// rarely contend for the same lock.  Entries are never evicted; keys and values
+// live in the shard's arena.
+class DemangleCache {
+ public:
+  std::string Demangle(string_view symbol, DataSource source) {
+    Key key{symbol, source};
+    Shard& shard = shards_[ShardIndex(KeyHash()(key))];
+    lookups_++;
+
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      auto it = shard.map.find(key);
+      if (it != shard.map.end()) {
+        hits_++;
+        return std::string(it->second);
+      }
+    }
+
+    // Demangle without holding the lock.  If another thread raced us to the
+    // same name, its entry wins; both results are identical.
+    string_view demangled = ItaniumDemangleView(symbol, source);
+
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      if (shard.map.find(key) == shard.map.end()) {
+        Key stored_key{shard.arena.Copy(symbol), source};
+        shard.map.emplace(stored_key, shard.arena.Copy(demangled));
+      }
+    }
+
+    return std::string(demangled);
+  }
+
+  void ResetStats() {
+    lookups_ = 0;
+    hits_ = 0;
+  }
+
+  void PrintStats() {
+    if (lookups_ == 0) {
+      return;
+    }
+    size_t entries = 0;
+    for (auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      entries += shard.map.size();
+    }
+    uint64_t lookups = lookups_;
+    uint64_t hits = hits_;
+    printf("Demangle cache: %" PRIu64 " lookups, %" PRIu64
+           " hits (%.1f%%), %zu entries\n",
+           lookups, hits, 100.0 * hits / lookups, entries);
+  }
+
+ private:
+  static constexpr size_t kShardBits = 6;
+
+  struct Key {
+    string_view symbol;
+    DataSource source;
+
+    bool operator==(const Key& other) const {
+      return source == other.source && symbol == other.symbol;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      return std::hash<string_view>()(key.symbol) ^
+             static_cast<size_t>(key.source);
+    }
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<Key, string_view, KeyHash> map;
+    StringArena arena;
+  };
+
+  static size_t ShardIndex(size_t hash) {
+    // Use the high bits, which the shard's own hash table doesn't depend on.
+    return (static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ULL) >>
+           (64 - kShardBits);
   }
+
+  Shard shards_[1 << kShardBits];
+  std::atomic<uint64_t> lookups_{0};
+  std::atomic<uint64_t> hits_{0};
+};
+
+DemangleCache* GetDemangleCache() {
+  // Intentionally leaked, so it outlives any thread still demangling.
+  static DemangleCache* cache = new DemangleCache;
+  return cache;
+}
+
+}  // namespace
+
+std::string ItaniumDemangle(string_view symbol, DataSource source) {
+  if (source == DataSource::kRawSymbols) {
+    // No demangling.
+    return std::string(symbol);
+  }
+
+  return GetDemangleCache()->Demangle(symbol, source);
 }
 
 
@@ -345,19 +527,95 @@ std::string ItaniumDemangle(string_view symbol, DataSource source) {
 void NameMunger::AddRegex(const std::string& regex, const std::string& replacement) {
   auto re2 = absl::make_unique<RE2>(regex);
   regexes_.push_back(std::make_pair(std::move(re2), replacement));
+
+  // Rebuild the set from scratch, since a set can't be added to once it has
+  // been compiled.  There are only ever a handful of regexes.
+  regex_set_ = absl::make_unique<RE2::Set>(RE2::Options(), RE2::UNANCHORED);
+  regex_set_indexes_.clear();
+  unset_indexes_.clear();
+  for (size_t i = 0; i < regexes_.size(); i++) {
+    if (!regexes_[i].first->ok()) {
+      continue;
+    } else if (regex_set_->Add(regexes_[i].first->pattern(), nullptr) >= 0) {
+      regex_set_indexes_.push_back(i);
+    } else {
+      unset_indexes_.push_back(i);
+    }
+  }
+  if (!regex_set_->Compile()) {
+    regex_set_.reset();
+  }
+  for (CacheShard& shard : cache_) {
+    shard.map.clear();
+    shard.names.clear();
+  }
+}
+
+bool NameMunger::TryRewrite(size_t index, const std::string& name,
+                            std::string* ret) const {
+  const auto& pair = regexes_[index];
+  return RE2::Extract(name, *pair.first, pair.second, ret);
 }
 
 std::string NameMunger::Munge(string_view name) const {
+  if (regexes_.empty()) {
+    return std::string(name);
+  }
+
+  CacheShard& shard = cache_[std::hash<string_view>()(name) % kCacheShards];
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.map.find(name);
+    if (it != shard.map.end()) {
+      return it->second;
+    }
+  }
+
   std::string name_str(name);
-  std::string ret(name);
 
-  for (const auto& pair : regexes_) {
-    if (RE2::Extract(name_str, *pair.first, pair.second, &ret)) {
-      return ret;
+  // The regexes that might rewrite the name, in the order they were added.
+  std::vector<size_t> candidates;
+  std::vector<int> matches;
+  RE2::Set::ErrorInfo error_info;
+  if (!regex_set_ ||
+      (!regex_set_->Match(name_str, &matches, &error_info) &&
+       error_info.kind != RE2::Set::kNoError)) {
+    // Without a set, or if its DFA ran out of memory, try every regex.
+    for (size_t i = 0; i < regexes_.size(); i++) {
+      candidates.push_back(i);
     }
+  } else {
+    // Only the regexes that matched can rewrite the name, along with any that
+    // the set couldn't take.
+    for (int match : matches) {
+      candidates.push_back(regex_set_indexes_[match]);
+    }
+    candidates.insert(candidates.end(), unset_indexes_.begin(),
+                      unset_indexes_.end());
+    std::sort(candidates.begin(), candidates.end());
   }
 
-  return name_str;
+  std::string ret;
+  bool rewritten = false;
+  for (size_t i : candidates) {
+    if (TryRewrite(i, name_str, &ret)) {
+      rewritten = true;
+      break;
+    }
+  }
+
+  if (!rewritten) {
+    ret = name_str;
+  }
+
+  // Another thread may have munged the same name while we weren't holding the
+  // lock; the result is the same either way.
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  if (shard.map.find(name) == shard.map.end()) {
+    shard.names.push_back(std::move(name_str));
+    shard.map.emplace(shard.names.back(), ret);
+  }
+  return ret;
 }
 
 
@@ -437,6 +695,14 @@ class Rollup {
     }
   }
 
+  // Demangles the labels of every level whose entry in |sources| is a
+  // demangling symbol source, merging labels that demangle to the same string.
+  // This is used when demangling was deferred while scanning, so that each
+  // distinct label is demangled once instead of once per symbol table entry.
+  void DemangleLabels(const std::vector<DataSource>& sources) {
+    DemangleLabels(sources, 0);
+  }
+
   // Add the values in "other" from this.
   void Add(const Rollup& other) {
     vm_total_ += other.vm_total_;
@@ -520,6 +786,39 @@ class Rollup {
     }
   }
 
+  void DemangleLabels(const std::vector<DataSource>& sources, size_t level) {
+    if (level >= sources.size()) {
+      return;
+    }
+
+    if (sources[level] != DataSource::kRawSymbols) {
+      std::vector<string_view> names;
+      names.reserve(children_.size());
+      for (const auto& child : children_) {
+        names.push_back(child.first);
+      }
+      std::vector<std::string> demangled_names =
+          ItaniumDemangleAll(names, sources[level]);
+
+      ChildMap demangled;
+      demangled.reserve(children_.size());
+      size_t i = 0;
+      for (auto& child : children_) {
+        auto& dest = demangled[std::move(demangled_names[i++])];
+        if (dest.get() == nullptr) {
+          dest = std::move(child.second);
+        } else {
+          dest->Add(*child.second);
+        }
+      }
+      children_ = std::move(demangled);
+    }
+
+    for (auto& child : children_) {
+      child.second->DemangleLabels(sources, level + 1);
+    }
+  }
+
   static double Percent(int64_t part, int64_t whole) {
     if (whole == 0) {
       if (part == 0) {
@@ -547,6 +846,8 @@ void Rollup::CreateRows(RollupRow* row, const Rollup* base,
     // the same label at the same level.
     row->vmpercent = Percent(vm_total_, base->vm_total_);
     row->filepercent = Percent(file_total_, base->file_total_);
+    row->base_vmsize = base->vm_total_;
+    row->base_filesize = base->file_total_;
   }
 
   for (const auto& value : children_) {
@@ -967,6 +1268,149 @@ void RollupOutput::PrintToCSV(std::ostream* out, bool tabs) const {
   }
 }
 
+// The columnar format is a simple little-endian layout meant for bulk loading
+// into analytics tools: every array starts on an 8-byte boundary, so a reader
+// can mmap() the file and use the columns in place.
+//
+//   char    magic[8]           "BLOATYC\0"
+//   uint32  version            1
+//   uint32  flags              bit 0: diff mode (base columns are present)
+//   uint64  row_count
+//   uint64  label_column_count (one per data source)
+//
+//   For each label column, in data source order:
+//     uint64  name_len
+//     char    name[name_len]                   (padded to 8 bytes)
+//     uint64  dict_size
+//     uint64  offsets[dict_size + 1]           (string i is data[off[i]:off[i+1]])
+//     char    data[offsets[dict_size]]         (padded to 8 bytes)
+//     uint32  index[row_count]                 (padded to 8 bytes)
+//
+//   int64   vmsize[row_count]
+//   int64   filesize[row_count]
+//   int64   base_vmsize[row_count]             (diff mode only)
+//   int64   base_filesize[row_count]           (diff mode only)
+//
+// Rows are the same as in CSV output, in the same order.  Labels are not
+// escaped, and a row that has no label at some level uses the empty string.
+
+namespace {
+
+struct ColumnarLabelColumn {
+  std::unordered_map<std::string, uint32_t> ids;
+  std::vector<const std::string*> dict;
+  std::vector<uint32_t> index;
+
+  uint32_t Intern(const std::string& label) {
+    auto pair = ids.emplace(label, dict.size());
+    if (pair.second) {
+      dict.push_back(&pair.first->first);
+    }
+    return pair.first->second;
+  }
+};
+
+struct ColumnarTable {
+  std::vector<ColumnarLabelColumn> labels;
+  std::vector<int64_t> vmsize;
+  std::vector<int64_t> filesize;
+  std::vector<int64_t> base_vmsize;
+  std::vector<int64_t> base_filesize;
+};
+
+void AddColumnarRows(const RollupRow& row, std::vector<uint32_t>* path,
+                     ColumnarTable* table) {
+  size_t depth = path->size();
+  path->push_back(table->labels[depth].Intern(row.name));
+
+  if (row.sorted_children.size() > 0) {
+    for (const auto& child_row : row.sorted_children) {
+      AddColumnarRows(child_row, path, table);
+    }
+  } else {
+    for (size_t i = 0; i < table->labels.size(); i++) {
+      auto& column = table->labels[i];
+      column.index.push_back(i < path->size() ? (*path)[i]
+                                              : column.Intern(""));
+    }
+    table->vmsize.push_back(row.vmsize);
+    table->filesize.push_back(row.filesize);
+    table->base_vmsize.push_back(row.base_vmsize);
+    table->base_filesize.push_back(row.base_filesize);
+  }
+
+  path->pop_back();
+}
+
+void AppendPadding(std::string* out) {
+  out->append((8 - (out->size() % 8)) % 8, '\0');
+}
+
+template <class T>
+void AppendColumn(const std::vector<T>& vals, std::string* out) {
+  if (IsLittleEndian()) {
+    out->append(reinterpret_cast<const char*>(vals.data()),
+                vals.size() * sizeof(T));
+  } else {
+    for (T val : vals) {
+      typedef typename std::make_unsigned<T>::type Unsigned;
+      Unsigned swapped = ByteSwap(static_cast<Unsigned>(val));
+      out->append(reinterpret_cast<const char*>(&swapped), sizeof(swapped));
+    }
+  }
+  AppendPadding(out);
+}
+
+template <class T>
+void AppendValue(T val, std::string* out) {
+  AppendColumn(std::vector<T>{val}, out);
+}
+
+}  // namespace
+
+void RollupOutput::PrintToColumnar(std::ostream* out) const {
+  ColumnarTable table;
+  table.labels.resize(source_names_.size());
+  std::vector<uint32_t> path;
+  for (const auto& child_row : toplevel_row_.sorted_children) {
+    AddColumnarRows(child_row, &path, &table);
+  }
+
+  std::string buf("BLOATYC\0", 8);
+  AppendColumn(std::vector<uint32_t>{1, diff_mode_ ? 1u : 0u}, &buf);
+  AppendValue<uint64_t>(table.vmsize.size(), &buf);
+  AppendValue<uint64_t>(table.labels.size(), &buf);
+
+  for (size_t i = 0; i < table.labels.size(); i++) {
+    const auto& column = table.labels[i];
+    AppendValue<uint64_t>(source_names_[i].size(), &buf);
+    buf.append(source_names_[i]);
+    AppendPadding(&buf);
+
+    std::vector<uint64_t> offsets;
+    std::string data;
+    offsets.push_back(0);
+    for (const std::string* label : column.dict) {
+      data.append(*label);
+      offsets.push_back(data.size());
+    }
+    AppendValue<uint64_t>(column.dict.size(), &buf);
+    AppendColumn(offsets, &buf);
+    buf.append(data);
+    AppendPadding(&buf);
+    AppendColumn(column.index, &buf);
+  }
+
+  AppendColumn(table.vmsize, &buf);
+  AppendColumn(table.filesize, &buf);
+  if (diff_mode_) {
+    AppendColumn(table.base_vmsize, &buf);
+    AppendColumn(table.base_filesize, &buf);
+  }
+
+  out->write(buf.data(), buf.size());
+}
+
 void RollupOutput::PrintToFlatBuffers(std::ostream* out) const {
   using namespace ::bloaty_report;
   flatbuffers::FlatBufferBuilder builder(16 * 1024);
@@ -1071,6 +1515,17 @@ std::unique_ptr<InputFile> MmapInputFileFactory::OpenFile(
   return absl::make_unique<MmapInputFile>(filename);
 }
 
+// Reads the build ID of |filename| without mapping it.  Returns false if the
+// file can't be opened or isn't ELF; other formats need GetObjectFile().
+static bool ProbeBuildId(const std::string& filename, std::string* build_id) {
+  FileDescriptor fd(open(filename.c_str(), O_RDONLY));
+  struct stat buf;
+  if (fd.fd() < 0 || fstat(fd.fd(), &buf) < 0) {
+    return false;
+  }
+  return ProbeELFBuildId(fd.fd(), buf.st_size, build_id);
+}
+
 
 // RangeSink ///////////////////////////////////////////////////////////////////
 
@@ -1079,6 +1534,7 @@ RangeSink::RangeSink(const InputFile* file, const Options& options,
     : file_(file),
       options_(options),
       data_source_(data_source),
+      demangle_source_(data_source),
       translator_(translator) {}
 
 RangeSink::~RangeSink() {}
@@ -1164,8 +1620,63 @@ void RangeSink::AddOutput(DualMap* map, const NameMunger* munger) {
   outputs_.push_back(std::make_pair(map, munger));
 }
 
+void RangeSink::AddOutputs(const RangeSink& other) {
+  outputs_.insert(outputs_.end(), other.outputs_.begin(), other.outputs_.end());
+}
+
+std::unique_ptr<RangeSink> RangeSink::CreateRecorder(const RangeSink& parent) {
+  std::unique_ptr<RangeSink> ret(new RangeSink(
+      parent.file_, parent.options_, parent.data_source_, parent.translator_));
+  ret->demangle_source_ = parent.demangle_source_;
+  ret->recording_ = true;
+  return ret;
+}
+
+RangeSink::RecordedRange* RangeSink::Record(RecordedRange::Type type,
+                                            const char* analyzer,
+                                            string_view name, uint64_t arg0,
+                                            uint64_t arg1, uint64_t arg2,
+                                            uint64_t arg3) {
+  recorded_.push_back(RecordedRange{type, analyzer, std::string(name),
+                                    {arg0, arg1, arg2, arg3}, {}});
+  return &recorded_.back();
+}
+
+void RangeSink::Replay(RangeSink* sink) const {
+  for (const auto& range : recorded_) {
+    const uint64_t* args = range.args;
+    switch (range.type) {
+      case RecordedRange::kRange:
+        sink->AddRange(range.analyzer, range.name, args[0], args[1], args[2],
+                       args[3]);
+        break;
+      case RecordedRange::kFileRange:
+        sink->AddFileRange(range.analyzer, range.name, args[0], args[1]);
+        break;
+      case RecordedRange::kFileRangeForVMAddr:
+        sink->AddFileRangeForVMAddr(range.analyzer, args[0],
+                                    range.file_ranges[0]);
+        break;
+      case RecordedRange::kFileRangeForFileRange:
+        sink->AddFileRangeForFileRange(range.analyzer, range.file_ranges[0],
+                                       range.file_ranges[1]);
+        break;
+      case RecordedRange::kVMRangeForVMAddr:
+        sink->AddVMRangeForVMAddr(range.analyzer, args[0], args[1], args[2]);
+        break;
+      case RecordedRange::kVMRange:
+        sink->AddVMRange(range.analyzer, args[0], args[1], range.name);
+        break;
+    }
+  }
+}
+
 void RangeSink::AddFileRange(const char* analyzer, string_view name,
                              uint64_t fileoff, uint64_t filesize) {
+  if (recording_) {
+    Record(RecordedRange::kFileRange, analyzer, name, fileoff, filesize);
+    return;
+  }
   bool verbose = IsVerboseForFileRange(fileoff, filesize);
   if (verbose) {
     printf("[%s, %s] AddFileRange(%.*s, %" PRIx64 ", %" PRIx64 ")\n",
@@ -1191,6 +1702,11 @@ void RangeSink::AddFileRange(const char* analyzer, string_view name,
 void RangeSink::AddFileRangeForVMAddr(const char* analyzer,
                                       uint64_t label_from_vmaddr,
                                       string_view file_range) {
+  if (recording_) {
+    Record(RecordedRange::kFileRangeForVMAddr, analyzer, string_view(),
+           label_from_vmaddr)->file_ranges[0] = file_range;
+    return;
+  }
   uint64_t file_offset = file_range.data() - file_->data().data();
   bool verbose = IsVerboseForFileRange(file_offset, file_range.size());
   if (verbose) {
@@ -1218,6 +1734,13 @@ void RangeSink::AddFileRangeForVMAddr(const char* analyzer,
 void RangeSink::AddFileRangeForFileRange(const char* analyzer,
                                          absl::string_view from_file_range,
                                          absl::string_view file_range) {
+  if (recording_) {
+    RecordedRange* range =
+        Record(RecordedRange::kFileRangeForFileRange, analyzer, string_view());
+    range->file_ranges[0] = from_file_range;
+    range->file_ranges[1] = file_range;
+    return;
+  }
   uint64_t file_offset = file_range.data() - file_->data().data();
   uint64_t from_file_offset = from_file_range.data() - file_->data().data();
   bool verbose = IsVerboseForFileRange(file_offset, file_range.size());
@@ -1249,6 +1772,11 @@ void RangeSink::AddFileRangeForFileRange(const char* analyzer,
 void RangeSink::AddVMRangeForVMAddr(const char* analyzer,
                                     uint64_t label_from_vmaddr, uint64_t addr,
                                     uint64_t size) {
+  if (recording_) {
+    Record(RecordedRange::kVMRangeForVMAddr, analyzer, string_view(),
+           label_from_vmaddr, addr, size);
+    return;
+  }
   bool verbose = IsVerboseForVMRange(addr, size);
   if (verbose) {
     printf("[%s, %s] AddVMRangeForVMAddr(%" PRIx64 ", [%" PRIx64 ", %" PRIx64
@@ -1275,6 +1803,10 @@ void RangeSink::AddVMRangeForVMAddr(const char* analyzer,
 
 void RangeSink::AddVMRange(const char* analyzer, uint64_t vmaddr,
                            uint64_t vmsize, const std::string& name) {
+  if (recording_) {
+    Record(RecordedRange::kVMRange, analyzer, name, vmaddr, vmsize);
+    return;
+  }
   bool verbose = IsVerboseForVMRange(vmaddr, vmsize);
   if (verbose) {
     printf("[%s, %s] AddVMRange(%.*s, %" PRIx64 ", %" PRIx64 ")\n",
@@ -1283,7 +1815,12 @@ void RangeSink::AddVMRange(const char* analyzer, uint64_t vmaddr,
   }
   assert(translator_);
   for (auto& pair : outputs_) {
-    const std::string label = pair.second->Munge(name);
+    // Most sources have no rewrites, so avoid copying the name for them.
+    std::string munged;
+    if (!pair.second->IsEmpty()) {
+      munged = pair.second->Munge(name);
+    }
+    const std::string& label = pair.second->IsEmpty() ? name : munged;
     bool ok = pair.first->vm_map.AddRangeWithTranslation(
         vmaddr, vmsize, label, translator_->vm_map, verbose,
         &pair.first->file_map);
@@ -1318,6 +1855,12 @@ void RangeSink::AddRange(const char* analyzer, string_view name,
     THROW("AddRange() does not allow unknown size.");
   }
 
+  if (recording_) {
+    Record(RecordedRange::kRange, analyzer, name, vmaddr, vmsize, fileoff,
+           filesize);
+    return;
+  }
+
   if (IsVerboseForVMRange(vmaddr, vmsize) ||
       IsVerboseForFileRange(fileoff, filesize)) {
     printf("[%s, %s] AddRange(%.*s, %" PRIx64 ", %" PRIx64 ", %" PRIx64
@@ -1407,6 +1950,139 @@ class ThreadSafeIterIndex {
   const int max_;
 };
 
+// Parallel loops nest: files, then archive members, then the symbols,
+// functions or DWARF units of each.  So that the threads don't multiply, they
+// all share one budget of hardware_concurrency() running threads.  A loop only
+// starts as many threads as are left in the budget, and the calling thread
+// always does its share of the work, so a loop that finds every CPU busy just
+// runs inline.
+class ThreadBudget {
+ public:
+  // Takes up to |wanted| threads from the budget, returning how many we got.
+  explicit ThreadBudget(int wanted) {
+    std::atomic<int>& spare = Spare();
+    int available = spare.load();
+    do {
+      claimed_ = std::min(wanted, available);
+      if (claimed_ <= 0) {
+        claimed_ = 0;
+        return;
+      }
+    } while (!spare.compare_exchange_weak(available, available - claimed_));
+  }
+
+  ~ThreadBudget() { Spare() += claimed_; }
+
+  int claimed() const { return claimed_; }
+
+ private:
+  BLOATY_DISALLOW_COPY_AND_ASSIGN(ThreadBudget);
+
+  // Every running thread but the main one comes out of this.
+  static std::atomic<int>& Spare() {
+    static std::atomic<int> spare(
+        std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return spare;
+  }
+
+  int claimed_;
+};
+
+// Runs |work| on the calling thread and on |extra| new threads, and waits for
+// all of them.  |work| must not throw.
+static void RunOnThreads(int extra, const std::function<void()>& work) {
+  std::vector<std::thread> threads(extra);
+  for (auto& thread : threads) {
+    thread = std::thread(work);
+  }
+  work();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+void ParallelForEach(size_t count, const std::function<void(size_t)>& func) {
+  if (count == 0) {
+    return;
+  }
+
+  ThreadBudget budget(std::min<size_t>(count - 1, INT_MAX));
+  ThreadSafeIterIndex index(count);
+
+  RunOnThreads(budget.claimed(), [&func, &index]() {
+    try {
+      int i;
+      while (index.TryGetNext(&i)) {
+        func(i);
+      }
+    } catch (const std::exception& e) {
+      // Including std::bad_alloc, which would otherwise terminate us.
+      index.Abort(e.what());
+    }
+  });
+
+  std::string error;
+  if (index.TryGetError(&error)) {
+    THROW(error.c_str());
+  }
+}
+
+std::vector<std::string> ItaniumDemangleAll(
+    const std::vector<string_view>& symbols, DataSource source) {
+  std::vector<std::string> ret(symbols.size());
+  if (source == DataSource::kRawSymbols) {
+    for (size_t i = 0; i < symbols.size(); i++) {
+      ret[i] = ItaniumDemangle(symbols[i], source);
+    }
+    return ret;
+  }
+
+  // Small chunks keep the threads evenly loaded, since names vary a lot in how
+  // expensive they are to demangle.
+  constexpr size_t kChunkSize = 1024;
+  size_t num_chunks = (symbols.size() + kChunkSize - 1) / kChunkSize;
+  ParallelForEach(num_chunks, [&symbols, source, &ret](size_t chunk) {
+    size_t end = std::min(symbols.size(), (chunk + 1) * kChunkSize);
+    for (size_t i = chunk * kChunkSize; i < end; i++) {
+      ret[i] = ItaniumDemangle(symbols[i], source);
+    }
+  });
+  return ret;
+}
+
+void DisassembleFindReferencesAll(
+    cs_arch arch, cs_mode mode,
+    const std::vector<std::pair<uint64_t, string_view>>& functions,
+    std::vector<DisassemblyReference>* refs) {
+  constexpr size_t kChunkSize = 256;
+  size_t num_chunks = (functions.size() + kChunkSize - 1) / kChunkSize;
+
+  // Each chunk gets its own buffer so they can be concatenated in order.
+  std::vector<std::vector<DisassemblyReference>> chunk_refs(num_chunks);
+
+  ParallelForEach(num_chunks, [arch, mode, &functions,
+                               &chunk_refs](size_t chunk) {
+    DisassemblyInfo info;
+    info.arch = arch;
+    info.mode = mode;
+    size_t end = std::min(functions.size(), (chunk + 1) * kChunkSize);
+    for (size_t i = chunk * kChunkSize; i < end; i++) {
+      info.start_address = functions[i].first;
+      info.text = functions[i].second;
+      DisassembleFindReferences(info, &chunk_refs[chunk]);
+    }
+  });
+
+  size_t total = refs->size();
+  for (const auto& chunk : chunk_refs) {
+    total += chunk.size();
+  }
+  refs->reserve(total);
+  for (const auto& chunk : chunk_refs) {
+    refs->insert(refs->end(), chunk.begin(), chunk.end());
+  }
+}
+
 
 // Bloaty //////////////////////////////////////////////////////////////////////
 
@@ -1431,6 +2107,9 @@ class Bloaty {
 
   void AddFilename(const std::string& filename, bool base_file);
   void AddDebugFilename(const std::string& filename);
+  void AddDebugFileDir(const std::string& dirname);
+  void AddDwpFilename(const std::string& filename);
+  void AddDwoDir(const std::string& dirname);
   void AddLinkMapFilename(const std::string& filename);
 
   size_t GetSourceCount() const { return sources_.size(); }
@@ -1473,6 +2152,15 @@ class Bloaty {
     }
   }
 
+  // Whether labels for this source are kept mangled while scanning and
+  // demangled afterwards by Rollup::DemangleLabels().
+  bool DefersDemangling(const ConfiguredDataSource& source) const {
+    return options_.defer_demangle() && !options_.has_source_filter() &&
+           source.munger->IsEmpty() &&
+           (source.effective_source == DataSource::kShortSymbols ||
+            source.effective_source == DataSource::kFullSymbols);
+  }
+
   void ScanAndRollupFiles(const std::vector<std::string>& filenames,
                           std::vector<std::string>* build_ids,
                           Rollup* rollup) const;
@@ -1480,6 +2168,7 @@ class Bloaty {
                          std::vector<std::string>* out_build_ids) const;
 
   std::unique_ptr<ObjectFile> GetObjectFile(const std::string& filename) const;
+  void LoadSplitDWARF();
 
   const InputFileFactory& file_factory_;
   const Options options_;
@@ -1504,6 +2193,13 @@ class Bloaty {
   std::vector<InputFileInfo> base_files_;
   std::map<std::string, std::string> debug_files_;
 
+  // Debug files found by --debug-file-dir, which may go unused.
+  std::map<std::string, std::string> debug_dir_files_;
+
+  // Files from --dwp and --dwo-dir, which are only loaded for compileunits.
+  std::vector<std::string> split_dwarf_filenames_;
+  dwarf::SplitFiles split_dwarf_;
+
   // "foo" -> "some/path/foo.map"
   std::map<std::string, std::string> link_map_files_;
 };
@@ -1553,8 +2249,12 @@ void Bloaty::AddFilename(const std::string& filename, bool is_base) {
 }
 
 void Bloaty::AddDebugFilename(const std::string& filename) {
-  auto object_file = GetObjectFile(filename);
-  std::string build_id = object_file->GetBuildId();
+  // Debug files are only needed for their build ID until we scan, and for ELF
+  // we can find that without opening the whole file.
+  std::string build_id;
+  if (!ProbeBuildId(filename, &build_id)) {
+    build_id = GetObjectFile(filename)->GetBuildId();
+  }
   if (build_id.size() == 0) {
     THROWF("File '$0' has no build ID, cannot be used as a debug file",
            filename);
@@ -1562,6 +2262,81 @@ void Bloaty::AddDebugFilename(const std::string& filename) {
   debug_files_[build_id] = filename;
 }
 
+void Bloaty::AddDebugFileDir(const std::string& dirname) {
+  namespace fs = std::filesystem;
+  std::vector<std::string> filenames;
+  std::error_code ec;
+  for (fs::recursive_directory_iterator iter(dirname, ec), end;
+       !ec && iter != end; iter.increment(ec)) {
+    if (iter->is_regular_file(ec)) {
+      filenames.push_back(iter->path().string());
+    }
+  }
+  if (ec) {
+    THROWF("couldn't read debug file directory '$0': $1", dirname,
+           ec.message());
+  }
+  std::sort(filenames.begin(), filenames.end());
+
+  std::vector<std::string> build_ids(filenames.size());
+  ParallelForEach(filenames.size(), [&filenames, &build_ids](size_t i) {
+    // Files that aren't ELF, or that we can't read, just don't match.
+    ProbeBuildId(filenames[i], &build_ids[i]);
+  });
+
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (build_ids[i].empty()) {
+      continue;
+    }
+    // A .build-id tree links both "xx/yyyy" (the binary) and
+    // "xx/yyyy.debug" (its debug file) to the same build ID.
+    auto pair = debug_dir_files_.emplace(build_ids[i], filenames[i]);
+    if (!pair.second && absl::EndsWith(filenames[i], ".debug") &&
+        !absl::EndsWith(pair.first->second, ".debug")) {
+      pair.first->second = filenames[i];
+    }
+  }
+}
+
+void Bloaty::AddDwpFilename(const std::string& filename) {
+  split_dwarf_filenames_.push_back(filename);
+}
+
+void Bloaty::AddDwoDir(const std::string& dirname) {
+  namespace fs = std::filesystem;
+  std::vector<std::string> filenames;
+  std::error_code ec;
+  for (fs::recursive_directory_iterator iter(dirname, ec), end;
+       !ec && iter != end; iter.increment(ec)) {
+    if (iter->is_regular_file(ec) && iter->path().extension() == ".dwo") {
+      filenames.push_back(iter->path().string());
+    }
+  }
+  if (ec) {
+    THROWF("couldn't read .dwo directory '$0': $1", dirname, ec.message());
+  }
+  std::sort(filenames.begin(), filenames.end());
+  split_dwarf_filenames_.insert(split_dwarf_filenames_.end(),
+                                filenames.begin(), filenames.end());
+}
+
+// A large binary can have thousands of .dwo files, so we map them and find
+// their sections in parallel.  We index their units by DWO ID once, here, for
+// all of the binaries.  The rest of each unit is only read by the DWARF reader
+// if a skeleton unit refers to it.
+void Bloaty::LoadSplitDWARF() {
+  size_t count = split_dwarf_filenames_.size();
+  split_dwarf_.inputs.resize(count);
+  split_dwarf_.files.resize(count);
+  ParallelForEach(count, [this](size_t i) {
+    split_dwarf_.inputs[i] = file_factory_.OpenFile(split_dwarf_filenames_[i]);
+    split_dwarf_.files[i] = absl::make_unique<dwarf::File>();
+    ReadELFDWARFSections(*split_dwarf_.inputs[i],
+                         split_dwarf_.files[i].get());
+  });
+  IndexSplitDWARF(&split_dwarf_);
+}
+
 void Bloaty::AddLinkMapFilename(const std::string& filename) {
   namespace fs = std::filesystem;
   std::string stem = fs::path(filename).stem();
@@ -1714,6 +2489,9 @@ void Bloaty::ScanAndRollupFile(const std::string &filename, Rollup* rollup,
                                                  source->effective_source,
                                                  maps.base_map()));
     sinks.back()->AddOutput(maps.AppendMap(), source->munger.get());
+    if (DefersDemangling(*source)) {
+      sinks.back()->DeferDemangling();
+    }
     // We handle the kInputFiles data source internally, without handing it off
     // to the file format implementation.  This seems slightly simpler, since
     // the file format has to deal with armembers too.
@@ -1734,9 +2512,17 @@ void Bloaty::ScanAndRollupFile(const std::string &filename, Rollup* rollup,
       debug_file = GetObjectFile(iter->second);
       file->set_debug_file(debug_file.get());
       out_build_ids->push_back(build_id);
+    } else if ((iter = debug_dir_files_.find(build_id)) !=
+               debug_dir_files_.end()) {
+      debug_file = GetObjectFile(iter->second);
+      file->set_debug_file(debug_file.get());
     }
   }
 
+  if (!split_dwarf_.files.empty()) {
+    file->set_split_dwarf(&split_dwarf_);
+  }
+
   int64_t filesize_before = rollup->file_total() +
       rollup->filtered_file_total();
   file->ProcessFile(sink_ptrs);
@@ -1801,8 +2587,10 @@ void Bloaty::ScanAndRollupFiles(
     const std::vector<std::string>& filenames,
     std::vector<std::string>* build_ids,
     Rollup * rollup) const {
-  int num_cpus = std::thread::hardware_concurrency();
-  int num_threads = std::min(num_cpus, static_cast<int>(filenames.size()));
+  // The calling thread only waits for the others, so it lends them its share
+  // of the thread budget.
+  ThreadBudget budget(static_cast<int>(filenames.size()) - 1);
+  int num_threads = budget.claimed() + 1;
 
   struct PerThreadData {
     Rollup rollup;
@@ -1827,7 +2615,7 @@ void Bloaty::ScanAndRollupFiles(
         while (index.TryGetNext(&j)) {
           ScanAndRollupFile(filenames[j], &data->rollup, &data->build_ids);
         }
-      } catch (const bloaty::Error& e) {
+      } catch (const std::exception& e) {
         index.Abort(e.what());
       }
     }, &thread_data[i]);
@@ -1862,6 +2650,13 @@ void Bloaty::ScanAndRollup(const Options& options, RollupOutput* output) {
     output->AddDataSourceName(name);
   }
 
+  if (!split_dwarf_filenames_.empty() &&
+      std::any_of(sources_.begin(), sources_.end(), [](const auto* source) {
+        return source->effective_source == DataSource::kCompileUnits;
+      })) {
+    LoadSplitDWARF();
+  }
+
   Rollup rollup;
   std::vector<std::string> build_ids;
   std::vector<std::string> input_filenames;
@@ -1870,6 +2665,20 @@ void Bloaty::ScanAndRollup(const Options& options, RollupOutput* output) {
   }
   ScanAndRollupFiles(input_filenames, &build_ids, &rollup);
 
+  std::vector<DataSource> deferred_sources;
+  bool any_deferred = false;
+  for (auto source : sources_) {
+    if (DefersDemangling(*source)) {
+      deferred_sources.push_back(source->effective_source);
+      any_deferred = true;
+    } else {
+      deferred_sources.push_back(DataSource::kRawSymbols);
+    }
+  }
+  if (any_deferred) {
+    rollup.DemangleLabels(deferred_sources);
+  }
+
   if (!base_files_.empty()) {
     Rollup base;
     std::vector<std::string> base_filenames;
@@ -1877,6 +2686,9 @@ void Bloaty::ScanAndRollup(const Options& options, RollupOutput* output) {
       base_filenames.push_back(file_info.filename_);
     }
     ScanAndRollupFiles(base_filenames, &build_ids, &base);
+    if (any_deferred) {
+      base.DemangleLabels(deferred_sources);
+    }
     rollup.Subtract(base);
     output->SetSymbolToCrateMap(symbol_to_crate_);
     rollup.CreateDiffModeRollupOutput(&base, options, output);
@@ -1939,9 +2751,18 @@ Options:
 
   --csv              Output in CSV format instead of human-readable.
   --tsv              Output in TSV format instead of human-readable.
+  --columnar         Output in a binary columnar format for bulk loading.
+                     See "Columnar Output" in README.md for the layout.
   -c FILE            Load configuration from <file>.
   -d SOURCE,SOURCE   Comma-separated list of sources to scan.
   --debug-file=FILE  Use this file for debug symbols and/or symbol table.
+  --debug-file-dir=DIR
+                     Search this directory (for example a .build-id tree)
+                     for ELF debug files that match the inputs' build IDs.
+  --dwp=FILE         Use this DWARF package for binaries built with
+                     -gsplit-dwarf (compileunits only).
+  --dwo-dir=DIR      Search this directory for the .dwo files of binaries
+                     built with -gsplit-dwarf (compileunits only).
   --link-map-file=FILE
                      Use this file for identifying a link map associated with
                      a binary. The link map and the binary must share the same
@@ -1951,6 +2772,19 @@ Options:
                        --demangle=short  demangle, but omit arg/return types
                        --demangle=full   print full demangled type
                      The default is --demangle=short.
+  --defer-demangle   Keep symbols mangled while scanning and only demangle
+                     the distinct labels that make it into the rollup.
+                     Produces the same output; faster for large symbol
+                     tables.  Ignored with --source-filter.
+  --no-disassembly-refs
+                     Don't disassemble functions to attribute the data they
+                     reference to them.  Faster, but less precise.
+  --dwarf-mode=MODE  How much DWARF the compileunits source reads:
+                       --dwarf-mode=full  every DIE (the default)
+                       --dwarf-mode=fast  only .debug_aranges and the first
+                                          DIE of each compile unit.  Much
+                                          faster, but data and most debug
+                                          strings are left unattributed.
   --disassemble=FUNCTION
                      Disassemble this function (EXPERIMENTAL)
   --domain=DOMAIN    Which domains to show.  Possible values are:
@@ -2101,6 +2935,8 @@ bool DoParseOptions(bool skip_unknown, int* argc, char** argv[],
       output_options->output_format = OutputFormat::kCSV;
     } else if (args.TryParseFlag("--tsv")) {
       output_options->output_format = OutputFormat::kTSV;
+    } else if (args.TryParseFlag("--columnar")) {
+      output_options->output_format = OutputFormat::kColumnar;
     } else if (args.TryParseFlag("--fbs")) {
       output_options->output_format = OutputFormat::kFlatBuffers;
     } else if (args.TryParseOption("-c", &option)) {
@@ -2128,8 +2964,26 @@ bool DoParseOptions(bool skip_unknown, int* argc, char** argv[],
       } else {
         THROWF("unknown value for --demangle: $0", option);
       }
+    } else if (args.TryParseFlag("--defer-demangle")) {
+      options->set_defer_demangle(true);
+    } else if (args.TryParseFlag("--no-disassembly-refs")) {
+      options->set_skip_disassembly_refs(true);
+    } else if (args.TryParseOption("--dwarf-mode", &option)) {
+      if (option == "full") {
+        options->set_dwarf_mode(Options::DWARF_MODE_FULL);
+      } else if (option == "fast") {
+        options->set_dwarf_mode(Options::DWARF_MODE_FAST);
+      } else {
+        THROWF("unknown value for --dwarf-mode: $0", option);
+      }
     } else if (args.TryParseOption("--debug-file", &option)) {
       options->add_debug_filename(std::string(option));
+    } else if (args.TryParseOption("--debug-file-dir", &option)) {
+      options->add_debug_file_dir(std::string(option));
+    } else if (args.TryParseOption("--dwp", &option)) {
+      options->add_dwp_filename(std::string(option));
+    } else if (args.TryParseOption("--dwo-dir", &option)) {
+      options->add_dwo_dir(std::string(option));
     } else if (args.TryParseOption("--link-map-file", &option)) {
       options->add_link_map_filename(std::string(option));
     } else if (args.TryParseUint64Option("--debug-fileoff", &uint64_option)) {
@@ -2274,6 +3128,18 @@ void BloatyDoMain(const Options& options, const InputFileFactory& file_factory,
     bloaty.AddDebugFilename(debug_filename);
   }
 
+  for (auto& debug_file_dir : options.debug_file_dir()) {
+    bloaty.AddDebugFileDir(debug_file_dir);
+  }
+
+  for (auto& dwp_filename : options.dwp_filename()) {
+    bloaty.AddDwpFilename(dwp_filename);
+  }
+
+  for (auto& dwo_dir : options.dwo_dir()) {
+    bloaty.AddDwoDir(dwo_dir);
+  }
+
   for (auto& link_map_filename : options.link_map_filename()) {
     bloaty.AddLinkMapFilename(link_map_filename);
   }
@@ -2294,12 +3160,19 @@ void BloatyDoMain(const Options& options, const InputFileFactory& file_factory,
   }
 
   verbose_level = options.verbose_level();
+  GetDemangleCache()->ResetStats();
+  ResetDWARFStats();
 
   if (options.data_source_size() > 0) {
     bloaty.ScanAndRollup(options, output);
   } else if (options.has_disassemble_function()) {
     bloaty.DisassembleFunction(options.disassemble_function(), options, output);
   }
+
+  if (verbose_level > 0) {
+    GetDemangleCache()->PrintStats();
+    PrintDWARFStats();
+  }
 }
 
 bool BloatyMain(const Options& options, const InputFileFactory& file_factory,
@@ -25,7 +25,11 @@
 #include <stdint.h>
 #include <inttypes.h>
 
+#include <array>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <unordered_map>
@@ -35,9 +39,11 @@
 #include "absl/strings/strip.h"
 #include "capstone/capstone.h"
 #include "re2/re2.h"
+#include "re2/set.h"
 
 #include "bloaty.pb.h"
 #include "range_map.h"
+#include "symbol_table.h"
 
 #define BLOATY_DISALLOW_COPY_AND_ASSIGN(class_name) \
   class_name(const class_name&) = delete; \
@@ -146,10 +152,30 @@ class RangeSink {
 
   void AddOutput(DualMap* map, const NameMunger* munger);
 
+  // Adds all of |other|'s outputs to this sink, so that ranges that do not
+  // depend on the data source can be read once and fed to several sinks.
+  void AddOutputs(const RangeSink& other);
+
+  // Creates a sink that records the ranges added to it instead of adding them
+  // to any outputs.  It otherwise behaves like |parent|, so different parts of
+  // a file can be read into several recorders in parallel; Replay() then adds
+  // the ranges to the real sink in a deterministic order.
+  static std::unique_ptr<RangeSink> CreateRecorder(const RangeSink& parent);
+
+  // Adds all ranges recorded by this sink to |sink|, in the order they were
+  // recorded.
+  void Replay(RangeSink* sink) const;
+
   DataSource data_source() const { return data_source_; }
   const InputFile& input_file() const { return *file_; }
   bool IsBaseMap() const { return translator_ == nullptr; }
 
+  // The mode that should be passed to ItaniumDemangle() for labels added to
+  // this sink.  This is kRawSymbols when demangling is deferred until the
+  // rollup is built (see Options.defer_demangle).
+  DataSource demangle_source() const { return demangle_source_; }
+  void DeferDemangling() { demangle_source_ = DataSource::kRawSymbols; }
+
   // If vmsize or filesize is zero, this mapping is presumed not to exist in
   // that domain.  For example, .bss mappings don't exist in the file, and
   // .debug_* mappings don't exist in memory.
@@ -246,8 +272,33 @@ class RangeSink {
   const InputFile* file_;
   const Options options_;
   DataSource data_source_;
+  DataSource demangle_source_;
   const DualMap* translator_;
   std::vector<std::pair<DualMap*, const NameMunger*>> outputs_;
+
+  // A call to one of the Add*() functions, for recorders.
+  struct RecordedRange {
+    enum Type {
+      kRange,                  // name, vmaddr, vmsize, fileoff, filesize
+      kFileRange,              // name, fileoff, filesize
+      kFileRangeForVMAddr,     // label_from_vmaddr, file_range
+      kFileRangeForFileRange,  // from_file_range, file_range
+      kVMRangeForVMAddr,       // label_from_vmaddr, vmaddr, vmsize
+      kVMRange,                // name, vmaddr, vmsize
+    } type;
+    const char* analyzer;
+    std::string name;
+    uint64_t args[4];
+    absl::string_view file_ranges[2];
+  };
+
+  bool recording_ = false;
+  std::vector<RecordedRange> recorded_;
+
+  RecordedRange* Record(RecordedRange::Type type, const char* analyzer,
+                        absl::string_view name, uint64_t arg0 = 0,
+                        uint64_t arg1 = 0, uint64_t arg2 = 0,
+                        uint64_t arg3 = 0);
 };
 
 
@@ -263,16 +314,46 @@ class NameMunger {
   // applied in sequence.
   void AddRegex(const std::string& regex, const std::string& replacement);
 
+  // Returns the name as rewritten by the first regex that matches, or the name
+  // itself if none match.  Results are memoized, since the same label is
+  // usually munged many times.  Thread-safe.
   std::string Munge(absl::string_view name) const;
 
   bool IsEmpty() const { return regexes_.empty(); }
 
  private:
   BLOATY_DISALLOW_COPY_AND_ASSIGN(NameMunger);
+  bool TryRewrite(size_t index, const std::string& name,
+                  std::string* ret) const;
+
   std::vector<std::pair<std::unique_ptr<RE2>, std::string>> regexes_;
+
+  // All of regexes_ compiled together, so that we can find which ones match in
+  // a single pass.  Null if the set failed to compile, in which case we try
+  // each regex in turn, as we also do for a name if the set runs out of memory.
+  std::unique_ptr<RE2::Set> regex_set_;
+  // Index into regexes_ for each pattern in regex_set_.  Patterns that don't
+  // compile by themselves are left out, since they can't match anything.
+  std::vector<size_t> regex_set_indexes_;
+  // Patterns that compile by themselves but that the set wouldn't take.  These
+  // are tried on every name, in order with the ones the set matched.
+  std::vector<size_t> unset_indexes_;
+
+  // Munge() is called from many threads at once, so the cache is split into
+  // shards with a lock each.  The map's keys point into |names|, whose
+  // elements never move, so that a lookup doesn't have to copy the name.
+  struct CacheShard {
+    std::mutex mutex;
+    std::unordered_map<absl::string_view, std::string> map;
+    std::deque<std::string> names;
+  };
+  static constexpr size_t kCacheShards = 16;
+  mutable std::array<CacheShard, kCacheShards> cache_;
 };
 
-typedef std::map<absl::string_view, std::pair<uint64_t, uint64_t>> SymbolTable;
+namespace dwarf {
+struct SplitFiles;
+}  // namespace dwarf
 
 // Represents an object/executable file in a format like ELF, Mach-O, PE, etc.
 // To support a new file type, implement this interface.
@@ -310,15 +391,28 @@ class ObjectFile {
 
   const ObjectFile& debug_file() const { return *debug_file_; }
 
+  // Sets the .dwo and .dwp files to look in for split DWARF.  |files| must
+  // outlive this instance.
+  void set_split_dwarf(const dwarf::SplitFiles* files) { split_dwarf_ = files; }
+
+  // Returns null if no split DWARF files were given.
+  const dwarf::SplitFiles* split_dwarf() const { return split_dwarf_; }
+
  private:
   std::unique_ptr<InputFile> file_data_;
   const ObjectFile* debug_file_;
+  const dwarf::SplitFiles* split_dwarf_ = nullptr;
 };
 
 std::unique_ptr<ObjectFile> TryOpenELFFile(std::unique_ptr<InputFile>& file, std::optional<std::string> link_map_file);
 std::unique_ptr<ObjectFile> TryOpenMachOFile(std::unique_ptr<InputFile>& file);
 std::unique_ptr<ObjectFile> TryOpenWebAssemblyFile(std::unique_ptr<InputFile>& file);
 
+// Reads the build ID of the ELF file open at |fd| with a few small reads of its
+// headers and notes.  Returns false if it isn't a well-formed ELF file, in
+// which case the caller should open it with the functions above instead.
+bool ProbeELFBuildId(int fd, uint64_t file_size, std::string* build_id);
+
 namespace dwarf {
 
 struct File {
@@ -332,19 +426,67 @@ struct File {
   absl::string_view debug_pubnames;
   absl::string_view debug_pubtypes;
   absl::string_view debug_ranges;
+
+  // DWARF 5.
+  absl::string_view debug_str_offsets;
+  absl::string_view debug_line_str;
+  absl::string_view debug_addr;
+  absl::string_view debug_rnglists;
+  absl::string_view debug_loclists;
+
+  // The index of a DWARF package (.dwp), which gives each split unit's part of
+  // the sections above.
+  absl::string_view debug_cu_index;
+
+  // Holds the contents of any sections that had to be decompressed, so the
+  // views above stay valid for as long as this File does.
+  std::vector<std::unique_ptr<char[]>> decompressed_sections;
+};
+
+class SplitUnitIndex;
+
+// The .dwo files and .dwp packages that hold most of the DWARF of binaries
+// built with -gsplit-dwarf.  The skeleton units left in a binary are matched
+// to the split units in these by DWO ID.
+struct SplitFiles {
+  SplitFiles();
+  ~SplitFiles();
+
+  std::vector<std::unique_ptr<InputFile>> inputs;
+  std::vector<std::unique_ptr<File>> files;
+
+  // The split units in |files| by DWO ID, from IndexSplitDWARF().  It is
+  // shared by every binary we read.
+  std::unique_ptr<SplitUnitIndex> index;
 };
 
 }  // namespace dwarf
 
+// Reads the DWARF sections of an ELF file, such as a .dwo file or a .dwp
+// package, into |dwarf|.  Provided by elf.cc.
+void ReadELFDWARFSections(const InputFile& file, dwarf::File* dwarf);
+
+// Finds the split units in |files|, reading the files in parallel.  Provided
+// by dwarf.cc.
+void IndexSplitDWARF(dwarf::SplitFiles* files);
+
 // Provided by dwarf.cc.  To use these, a module should fill in a dwarf::File
-// and then call these functions.
-void ReadDWARFCompileUnits(const dwarf::File& file, const SymbolTable& symtab,
-                           const DualMap& map, RangeSink* sink);
+// and then call these functions.  |split| may be null, and otherwise must have
+// been indexed with IndexSplitDWARF().
+void ReadDWARFCompileUnits(const dwarf::File& file,
+                           const dwarf::SplitFiles* split,
+                           const SymbolTable& symtab, const DualMap& map,
+                           RangeSink* sink);
 void ReadDWARFInlines(const dwarf::File& file, RangeSink* sink,
                       bool include_line);
 void ReadEhFrame(absl::string_view contents, RangeSink* sink);
 void ReadEhFrameHdr(absl::string_view contents, RangeSink* sink);
 
+// Totals gathered while reading DWARF, which are printed for -v.  Each run
+// resets them first, so they don't accumulate across runs in one process.
+void PrintDWARFStats();
+void ResetDWARFStats();
+
 
 // LineReader //////////////////////////////////////////////////////////////////
 
@@ -406,6 +548,24 @@ LineReader ReadLinesFromPipe(const std::string& cmd);
 // controls what demangling mode we are using.
 std::string ItaniumDemangle(absl::string_view symbol, DataSource source);
 
+// Like ItaniumDemangle(), but doesn't allocate: the result points into |symbol|
+// or into per-thread scratch storage that is overwritten by the next call on
+// the same thread.  Copy the result if it needs to be kept.
+absl::string_view ItaniumDemangleView(absl::string_view symbol,
+                                      DataSource source);
+
+// Demangles all of |symbols|, using several threads for large inputs.  The
+// results are in the same order as |symbols|.
+std::vector<std::string> ItaniumDemangleAll(
+    const std::vector<absl::string_view>& symbols, DataSource source);
+
+// Calls |func| for every index in [0, count), spread across up to one thread
+// per CPU.  Calls can nest: all of them share one limit of a thread per CPU,
+// and a call that finds no threads left runs on the calling thread.  If |func|
+// throws, the remaining indexes are skipped and the error is rethrown as a
+// bloaty::Error once all threads have finished.
+void ParallelForEach(size_t count, const std::function<void(size_t)>& func);
+
 
 // DualMap /////////////////////////////////////////////////////////////////////
 
@@ -424,8 +584,23 @@ struct DisassemblyInfo {
   uint64_t start_address;
 };
 
+// An instruction at |from_address| that refers to data at |to_address|.
+struct DisassemblyReference {
+  uint64_t from_address;
+  uint64_t to_address;
+};
+
 std::string DisassembleFunction(const DisassemblyInfo& info);
-void DisassembleFindReferences(const DisassemblyInfo& info, RangeSink* sink);
+void DisassembleFindReferences(const DisassemblyInfo& info,
+                               std::vector<DisassemblyReference>* refs);
+
+// Finds the references in many functions of the same |arch| and |mode|, given
+// as (start address, text) pairs.  The functions are split across threads, but
+// the references are appended in the order of |functions|.
+void DisassembleFindReferencesAll(
+    cs_arch arch, cs_mode mode,
+    const std::vector<std::pair<uint64_t, absl::string_view>>& functions,
+    std::vector<DisassemblyReference>* refs);
 
 // Top-level API ///////////////////////////////////////////////////////////////
 
@@ -442,6 +617,9 @@ struct RollupRow {
   int64_t filtered_vmsize = 0;
   int64_t filtered_filesize = 0;
   int64_t other_count = 0;
+  // In diff mode, the sizes of this row in the base file(s).
+  int64_t base_vmsize = 0;
+  int64_t base_filesize = 0;
   int64_t sortkey;
   double vmpercent;
   double filepercent;
@@ -461,6 +639,7 @@ enum class OutputFormat {
   kPrettyPrint,
   kCSV,
   kTSV,
+  kColumnar,
   kFlatBuffers,
 };
 
@@ -498,6 +677,9 @@ struct RollupOutput {
         case bloaty::OutputFormat::kTSV:
           PrintToCSV(out, /*tabs=*/true);
           break;
+        case bloaty::OutputFormat::kColumnar:
+          PrintToColumnar(out);
+          break;
         case bloaty::OutputFormat::kFlatBuffers:
           PrintToFlatBuffers(out);
           break;
@@ -540,6 +722,7 @@ struct RollupOutput {
   static bool IsSame(const std::string& a, const std::string& b);
   void PrettyPrint(const OutputOptions& options, std::ostream* out) const;
   void PrintToCSV(std::ostream* out, bool tabs) const;
+  void PrintToColumnar(std::ostream* out) const;
   void PrintToFlatBuffers(std::ostream* out) const;
   void PrettyPrintRow(const RollupRow& row, size_t indent,
                       const OutputOptions& options, std::ostream* out) const;
@@ -43,25 +43,69 @@ static std::string RightPad(const std::string& input, size_t size) {
   return ret;
 }
 
+// Setting up a Capstone handle costs more than disassembling a typical
+// function, so each thread keeps one open and reuses it for every function it
+// scans.
+class CapstoneContext {
+ public:
+  ~CapstoneContext() { Close(); }
+
+  // Returns a detail-enabled handle for |arch| and |mode|, along with a
+  // reusable instruction buffer.
+  csh Get(cs_arch arch, cs_mode mode, cs_insn** insn) {
+    if (!open_ || arch != arch_ || mode != mode_) {
+      Close();
+      if (cs_open(arch, mode, &handle_) != CS_ERR_OK) {
+        THROW("Couldn't initialize Capstone");
+      }
+      open_ = true;
+      arch_ = arch;
+      mode_ = mode;
+      if (cs_option(handle_, CS_OPT_DETAIL, CS_OPT_ON) != CS_ERR_OK) {
+        Close();
+        THROW("Couldn't initialize Capstone");
+      }
+      insn_ = cs_malloc(handle_);
+    }
+    *insn = insn_;
+    return handle_;
+  }
+
+ private:
+  void Close() {
+    if (!open_) return;
+    if (insn_) {
+      cs_free(insn_, 1);
+      insn_ = nullptr;
+    }
+    cs_close(&handle_);
+    open_ = false;
+  }
+
+  bool open_ = false;
+  cs_arch arch_;
+  cs_mode mode_;
+  csh handle_;
+  cs_insn* insn_ = nullptr;
+};
+
+thread_local CapstoneContext capstone_context;
+
 }  // anonymous namespace
 
-void DisassembleFindReferences(const DisassemblyInfo& info, RangeSink* sink) {
+void DisassembleFindReferences(const DisassemblyInfo& info,
+                               std::vector<DisassemblyReference>* refs) {
   if (info.arch != CS_ARCH_X86) {
     // x86 only for now.
     return;
   }
 
-  csh handle;
-  if (cs_open(info.arch, info.mode, &handle) != CS_ERR_OK ||
-      cs_option(handle, CS_OPT_DETAIL, CS_OPT_ON) != CS_ERR_OK) {
-    THROW("Couldn't initialize Capstone");
-  }
-
   if (info.text.size() == 0) {
     THROW("Tried to disassemble empty function.");
   }
 
-  cs_insn *in = cs_malloc(handle);
+  cs_insn *in;
+  csh handle = capstone_context.Get(info.arch, info.mode, &in);
   uint64_t address = info.start_address;
   const uint8_t* ptr = reinterpret_cast<const uint8_t*>(info.text.data());
   size_t size = info.text.size();
@@ -74,7 +118,7 @@ void DisassembleFindReferences(const DisassemblyInfo& info, RangeSink* sink) {
         printf("Error disassembling function at address: %" PRIx64 "\n",
                address);
       }
-      goto cleanup;
+      return;
     }
 
     size_t count = in->detail->x86.op_count;
@@ -85,16 +129,11 @@ void DisassembleFindReferences(const DisassemblyInfo& info, RangeSink* sink) {
           op->mem.index == X86_REG_INVALID) {
         uint64_t to_address = in->address + in->size + op->mem.disp;
         if (to_address) {
-          sink->AddVMRangeForVMAddr("x86_disassemble", in->address, to_address,
-                                    RangeSink::kUnknownSize);
+          refs->push_back({in->address, to_address});
         }
       }
     }
   }
-
-cleanup:
-  cs_free(in, 1);
-  cs_close(&handle);
 }
 
 bool TryGetJumpTarget(cs_arch arch, cs_insn *in, uint64_t* target) {
@@ -16,10 +16,13 @@
 #include <stdio.h>
 
 #include <algorithm>
+#include <atomic>
+#include <functional>
 #include <initializer_list>
 #include <iostream>
 #include <memory>
 #include <stack>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -32,6 +35,7 @@
 #include "bloaty.h"
 #include "bloaty.pb.h"
 #include "dwarf_constants.h"
+#include "leb128.h"
 #include "re2/re2.h"
 
 using namespace dwarf2reader;
@@ -122,30 +126,23 @@ void SkipNullTerminated(string_view* data) {
   data->remove_prefix(len + 1);  // Remove NULL also.
 }
 
+// Reads the 3-byte values of DW_FORM_strx3 and DW_FORM_addrx3.
+uint32_t ReadUint24(string_view* data) {
+  string_view bytes = ReadPiece(3, data);
+  return static_cast<uint8_t>(bytes[0]) |
+         static_cast<uint8_t>(bytes[1]) << 8 |
+         static_cast<uint8_t>(bytes[2]) << 16;
+}
+
 // Parses the LEB128 format defined by DWARF (both signed and unsigned
 // versions).
 
 uint64_t ReadLEB128Internal(bool is_signed, string_view* data) {
-  uint64_t ret = 0;
-  int shift = 0;
-  int maxshift = 70;
-  const char* ptr = data->data();
-  const char* limit = ptr + data->size();
-
-  while (ptr < limit && shift < maxshift) {
-    char byte = *(ptr++);
-    ret |= static_cast<uint64_t>(byte & 0x7f) << shift;
-    shift += 7;
-    if ((byte & 0x80) == 0) {
-      data->remove_prefix(ptr - data->data());
-      if (is_signed && shift < 64 && (byte & 0x40)) {
-        ret |= -(1ULL << shift);
-      }
-      return ret;
-    }
+  uint64_t ret;
+  if (!leb128::Decode(is_signed, 64, data, &ret)) {
+    THROW("corrupt DWARF data, unterminated LEB128");
   }
-
-  THROW("corrupt DWARF data, unterminated LEB128");
+  return ret;
 }
 
 template <typename T>
@@ -161,16 +158,15 @@ T ReadLEB128(string_view* data) {
 }
 
 void SkipLEB128(string_view* data) {
-  size_t limit =
-      std::min(static_cast<size_t>(data->size()), static_cast<size_t>(10));
-  for (size_t i = 0; i < limit; i++) {
-    if (((*data)[i] & 0x80) == 0) {
-      data->remove_prefix(i + 1);
-      return;
-    }
+  if (!leb128::Skip(data)) {
+    THROW("corrupt DWARF data, unterminated LEB128");
   }
+}
 
-  THROW("corrupt DWARF data, unterminated LEB128");
+void SkipLEB128s(size_t count, string_view* data) {
+  if (!leb128::SkipMany(count, data)) {
+    THROW("corrupt DWARF data, unterminated LEB128");
+  }
 }
 
 // Some size information attached to each compilation unit.  The size of an
@@ -196,8 +192,8 @@ class CompilationUnitSizes {
 
   // To allow this as the key in a map.
   bool operator<(const CompilationUnitSizes& rhs) const {
-    return std::tie(dwarf64_, address_size_) <
-           std::tie(rhs.dwarf64_, rhs.address_size_);
+    return std::tie(dwarf64_, address_size_, dwarf_version_) <
+           std::tie(rhs.dwarf64_, rhs.address_size_, rhs.dwarf_version_);
   }
 
   // Reads a DWARF offset based on whether we are reading dwarf32 or dwarf64
@@ -272,63 +268,124 @@ class CompilationUnitSizes {
 
 class AbbrevTable {
  public:
+  AbbrevTable() {}
+
   // Reads abbreviations until a terminating abbreviation is seen.
   string_view ReadAbbrevs(string_view data);
 
-  // In a DWARF abbreviation, each attribute has a name and a form.
+  // In a DWARF abbreviation, each attribute has a name and a form.  For
+  // DW_FORM_implicit_const the value is stored here rather than in the DIE.
   struct Attribute {
     uint16_t name;
-    uint8_t form;
+    uint16_t form;
+    int64_t implicit_const;
+  };
+
+  // The attributes of one abbreviation, stored in the table's arena.
+  class AttributeList {
+   public:
+    const Attribute* begin() const { return begin_; }
+    const Attribute* end() const { return end_; }
+    size_t size() const { return end_ - begin_; }
+
+   private:
+    friend class AbbrevTable;
+    const Attribute* begin_ = nullptr;
+    const Attribute* end_ = nullptr;
   };
 
   // The representation of a single abbreviation.
   struct Abbrev {
     uint32_t code;
+    uint32_t index;  // Position in the table, from 0 to size() - 1.
     uint16_t tag;
     bool has_child;
-    std::vector<Attribute> attr;
+    AttributeList attr;
   };
 
-  bool IsEmpty() const { return abbrev_.empty(); }
+  bool IsEmpty() const { return abbrevs_.empty(); }
+  size_t size() const { return abbrevs_.size(); }
+
+  // The portion of .debug_abbrev that ReadAbbrevs() consumed, including the
+  // terminating abbreviation.
+  string_view data() const { return data_; }
 
   // Looks for an abbreviation with the given code.  Returns true if the lookup
   // succeeded.
   bool GetAbbrev(uint32_t code, const Abbrev** abbrev) const {
-    auto it = abbrev_.find(code);
-    if (it != abbrev_.end()) {
-      *abbrev = &it->second;
-      return true;
+    uint32_t index;
+    if (code < index_by_code_.size()) {
+      index = index_by_code_[code];
+      if (index == kNoAbbrev) {
+        return false;
+      }
     } else {
-      return false;
+      auto it = sparse_index_by_code_.find(code);
+      if (it == sparse_index_by_code_.end()) {
+        return false;
+      }
+      index = it->second;
     }
+    *abbrev = &abbrevs_[index];
+    return true;
   }
 
  private:
-  // Keyed by abbreviation code.
-  // Generally we expect these to be small, so we could almost use a vector<>.
-  // But you never know what crazy input data is going to do...
-  std::unordered_map<uint32_t, Abbrev> abbrev_;
+  BLOATY_DISALLOW_COPY_AND_ASSIGN(AbbrevTable);
+
+  static constexpr uint32_t kNoAbbrev = UINT32_MAX;
+
+  void AddCode(uint32_t code, uint32_t index);
+
+  std::vector<Abbrev> abbrevs_;
+  std::vector<Attribute> attrs_;
+
+  // Codes are generally numbered from 1, so we index abbrevs_ with a vector.
+  // But you never know what crazy input data is going to do, so codes that
+  // would make the vector too sparse go in a map instead.
+  std::vector<uint32_t> index_by_code_;
+  std::unordered_map<uint32_t, uint32_t> sparse_index_by_code_;
+
+  string_view data_;
 };
 
+constexpr uint32_t AbbrevTable::kNoAbbrev;
+
+void AbbrevTable::AddCode(uint32_t code, uint32_t index) {
+  bool added;
+  if (code < index_by_code_.size()) {
+    added = index_by_code_[code] == kNoAbbrev;
+    index_by_code_[code] = index;
+  } else {
+    added = sparse_index_by_code_.emplace(code, index).second;
+  }
+
+  if (!added) {
+    THROW("DWARF data contained duplicate abbrev code");
+  }
+}
+
 string_view AbbrevTable::ReadAbbrevs(string_view data) {
+  const char* start = data.data();
+  std::vector<size_t> attr_offsets;
+  uint32_t max_code = 0;
+
   while (true) {
     uint32_t code = ReadLEB128<uint32_t>(&data);
 
     if (code == 0) {
-      return data;  // Terminator entry.
-    }
-
-    Abbrev& abbrev = abbrev_[code];
-
-    if (abbrev.code) {
-      THROW("DWARF data contained duplicate abbrev code");
+      break;  // Terminator entry.
     }
 
+    abbrevs_.emplace_back();
+    Abbrev& abbrev = abbrevs_.back();
     uint8_t has_child;
 
     abbrev.code = code;
+    abbrev.index = abbrevs_.size() - 1;
     abbrev.tag = ReadLEB128<uint16_t>(&data);
     has_child = ReadMemcpy<uint8_t>(&data);
+    max_code = std::max(max_code, code);
 
     switch (has_child) {
       case DW_children_yes:
@@ -341,18 +398,41 @@ string_view AbbrevTable::ReadAbbrevs(string_view data) {
         THROW("DWARF has_child is neither true nor false.");
     }
 
+    attr_offsets.push_back(attrs_.size());
+
     while (true) {
       Attribute attr;
       attr.name = ReadLEB128<uint16_t>(&data);
-      attr.form = ReadLEB128<uint8_t>(&data);
+      attr.form = ReadLEB128<uint16_t>(&data);
+      attr.implicit_const = 0;
 
       if (attr.name == 0 && attr.form == 0) {
         break;  // End of this abbrev
       }
 
-      abbrev.attr.push_back(attr);
+      if (attr.form == DW_FORM_implicit_const) {
+        attr.implicit_const = ReadLEB128<int64_t>(&data);
+      }
+
+      attrs_.push_back(attr);
     }
   }
+
+  // The arena is complete, so now we can point the abbrevs into it.
+  attr_offsets.push_back(attrs_.size());
+  for (size_t i = 0; i < abbrevs_.size(); i++) {
+    abbrevs_[i].attr.begin_ = attrs_.data() + attr_offsets[i];
+    abbrevs_[i].attr.end_ = attrs_.data() + attr_offsets[i + 1];
+  }
+
+  size_t dense_size = std::min<size_t>(max_code, abbrevs_.size() * 2 + 64) + 1;
+  index_by_code_.assign(dense_size, kNoAbbrev);
+  for (const Abbrev& abbrev : abbrevs_) {
+    AddCode(abbrev.code, abbrev.index);
+  }
+
+  data_ = string_view(start, data.data() - start);
+  return data;
 }
 
 
@@ -457,7 +537,8 @@ bool AddressRanges::NextUnit() {
 
 // LocationList ////////////////////////////////////////////////////////////////
 
-// Code for reading entries out of a location list.
+// Code for reading entries out of a location list, from .debug_loc or (for
+// DWARF 5) .debug_loclists.
 // For the moment we only care about finding the bounds of a list given its
 // offset, so we don't actually vend any of the data.
 
@@ -470,11 +551,17 @@ class LocationList {
   bool NextEntry();
 
  private:
+  bool NextEntryV5();
+
   CompilationUnitSizes sizes_;
   string_view remaining_;
 };
 
 bool LocationList::NextEntry() {
+  if (sizes_.dwarf_version() >= 5) {
+    return NextEntryV5();
+  }
+
   uint64_t start, end;
   start = sizes_.ReadAddress(&remaining_);
   end = sizes_.ReadAddress(&remaining_);
@@ -491,6 +578,40 @@ bool LocationList::NextEntry() {
   return true;
 }
 
+bool LocationList::NextEntryV5() {
+  switch (ReadMemcpy<uint8_t>(&remaining_)) {
+    case DW_LLE_end_of_list:
+      return false;
+    case DW_LLE_base_addressx:
+      SkipLEB128(&remaining_);
+      return true;
+    case DW_LLE_base_address:
+      sizes_.ReadAddress(&remaining_);
+      return true;
+    case DW_LLE_startx_endx:
+    case DW_LLE_startx_length:
+    case DW_LLE_offset_pair:
+      SkipLEB128s(2, &remaining_);
+      break;
+    case DW_LLE_default_location:
+      break;
+    case DW_LLE_start_end:
+      sizes_.ReadAddress(&remaining_);
+      sizes_.ReadAddress(&remaining_);
+      break;
+    case DW_LLE_start_length:
+      sizes_.ReadAddress(&remaining_);
+      SkipLEB128(&remaining_);
+      break;
+    default:
+      THROW("unknown DWARF location list entry");
+  }
+
+  // Skip the counted location description.
+  SkipBytes(ReadLEB128<uint64_t>(&remaining_), &remaining_);
+  return true;
+}
+
 string_view GetLocationListRange(CompilationUnitSizes sizes,
                                  string_view available) {
   LocationList list(sizes, available);
@@ -501,7 +622,8 @@ string_view GetLocationListRange(CompilationUnitSizes sizes,
 
 // RangeList ///////////////////////////////////////////////////////////////////
 
-// Code for reading entries out of a range list.
+// Code for reading entries out of a range list, from .debug_ranges or (for
+// DWARF 5) .debug_rnglists.
 // For the moment we only care about finding the bounds of a list given its
 // offset, so we don't actually vend any of the data.
 
@@ -514,11 +636,17 @@ class RangeList {
   bool NextEntry();
 
  private:
+  bool NextEntryV5();
+
   CompilationUnitSizes sizes_;
   string_view remaining_;
 };
 
 bool RangeList::NextEntry() {
+  if (sizes_.dwarf_version() >= 5) {
+    return NextEntryV5();
+  }
+
   uint64_t start, end;
   start = sizes_.ReadAddress(&remaining_);
   end = sizes_.ReadAddress(&remaining_);
@@ -528,6 +656,35 @@ bool RangeList::NextEntry() {
   return true;
 }
 
+bool RangeList::NextEntryV5() {
+  switch (ReadMemcpy<uint8_t>(&remaining_)) {
+    case DW_RLE_end_of_list:
+      return false;
+    case DW_RLE_base_addressx:
+      SkipLEB128(&remaining_);
+      break;
+    case DW_RLE_startx_endx:
+    case DW_RLE_startx_length:
+    case DW_RLE_offset_pair:
+      SkipLEB128s(2, &remaining_);
+      break;
+    case DW_RLE_base_address:
+      sizes_.ReadAddress(&remaining_);
+      break;
+    case DW_RLE_start_end:
+      sizes_.ReadAddress(&remaining_);
+      sizes_.ReadAddress(&remaining_);
+      break;
+    case DW_RLE_start_length:
+      sizes_.ReadAddress(&remaining_);
+      SkipLEB128(&remaining_);
+      break;
+    default:
+      THROW("unknown DWARF range list entry");
+  }
+  return true;
+}
+
 string_view GetRangeListRange(CompilationUnitSizes sizes,
                               string_view available) {
   RangeList list(sizes, available);
@@ -536,6 +693,33 @@ string_view GetRangeListRange(CompilationUnitSizes sizes,
   return available.substr(0, list.read_offset() - available.data());
 }
 
+// DWARF 5 Tables //////////////////////////////////////////////////////////////
+
+// DWARF 5 moved some attribute values out of the DIEs into per-unit tables in
+// .debug_str_offsets, .debug_addr, .debug_rnglists and .debug_loclists, which
+// DIEs refer to by index.  Each unit's contribution to a table starts with a
+// header of the size below (in 32-bit DWARF; a 64-bit initial length makes it
+// 8 bytes longer), and the unit's DW_AT_*_base attribute points just past it.
+
+constexpr size_t kStrOffsetsHeaderSize = 8;
+constexpr size_t kAddrHeaderSize = 8;
+constexpr size_t kListsHeaderSize = 12;
+
+size_t TableHeaderSize(CompilationUnitSizes sizes, size_t size) {
+  return sizes.dwarf64() ? size + 8 : size;
+}
+
+// Returns entry |index| of the array of |entry_size| byte entries at offset
+// |base| of |section|.
+string_view ReadTableEntry(string_view section, uint64_t base, uint64_t index,
+                           size_t entry_size) {
+  SkipBytes(base, &section);
+  if (index >= section.size() / entry_size) {
+    THROW("DWARF table index out of range");
+  }
+  return section.substr(index * entry_size, entry_size);
+}
+
 // DIEReader ///////////////////////////////////////////////////////////////////
 
 // Reads a sequence of DWARF DIE's (Debugging Information Entries) from the
@@ -544,11 +728,19 @@ string_view GetRangeListRange(CompilationUnitSizes sizes,
 // Each DIE contains a tag and a set of attribute/value pairs.  We rely on the
 // abbreviations in an AbbrevTable to decode the DIEs.
 
+template <class T>
+class AttrReader;
+
+// Bytes of DIEs passed over by DIEReader::SkipChildren(), for -v output.
+std::atomic<uint64_t> skipped_die_bytes;
+std::atomic<uint64_t> sibling_skipped_die_bytes;
+
 class DIEReader {
  public:
   // Constructs a new DIEReader.  Cannot be used until you call one of the
   // Seek() methods below.
-  DIEReader(const File& file) : dwarf_(file) {}
+  DIEReader(const File& file);
+  ~DIEReader();
 
   // Returns true if we are at the end of DIEs for this compilation unit.
   bool IsEof() const { return state_ == State::kEof; }
@@ -574,7 +766,10 @@ class DIEReader {
   bool NextDIE();
 
   // Skips children of the current DIE, so that the next call to NextDIE()
-  // will read the next sibling (or parent, if no sibling exists).
+  // will read the next sibling (or parent, if no sibling exists).  Uses
+  // DW_AT_sibling to jump over the children when the DIE has one.  Strings
+  // referenced by the skipped DIEs are not reported to the strp sink, whether
+  // or not the children had to be decoded.
   bool SkipChildren();
 
   const AbbrevTable::Abbrev& GetAbbrev() const {
@@ -596,18 +791,65 @@ class DIEReader {
   CompilationUnitSizes unit_sizes() const { return unit_sizes_; }
   uint32_t abbrev_version() const { return abbrev_version_; }
   uint64_t debug_abbrev_offset() const { return debug_abbrev_offset_; }
+  const AbbrevTable& unit_abbrev() const { return *unit_abbrev_; }
+
+  // The offsets of this unit's tables (see "DWARF 5 Tables" above), from the
+  // DW_AT_*_base attributes of its first DIE.  These are unset for units
+  // before DWARF 5 and for units that don't have the attribute.
+  struct UnitBases {
+    absl::optional<uint64_t> str_offsets;
+    absl::optional<uint64_t> addr;
+    absl::optional<uint64_t> rnglists;
+    absl::optional<uint64_t> loclists;
+  };
+  const UnitBases& unit_bases() const { return unit_bases_; }
+
+  // The DWO ID that links a DWARF 5 skeleton unit to its split unit, from the
+  // header of either one.  Before DWARF 5 this was the DW_AT_GNU_dwo_id
+  // attribute instead.
+  absl::optional<uint64_t> unit_dwo_id() const { return unit_dwo_id_; }
+
+  // A split unit's addresses are in the .debug_addr of the binary, starting
+  // at the DW_AT_addr_base of its skeleton unit.  This sets that base for the
+  // units we read after this call.
+  void set_skeleton_addr_base(absl::optional<uint64_t> base) {
+    skeleton_addr_base_ = base;
+  }
+
+  // Look up the values of the DWARF 5 index forms in this unit's tables.  For
+  // range and location lists this is the list's offset in its section.  A
+  // unit without a base attribute uses the first table in the section, as
+  // split DWARF units do.  The GNU split DWARF that came before DWARF 5 had
+  // no table headers, so there the first table starts at offset 0.
+  string_view ReadIndexedString(uint64_t index) const;
+  uint64_t ReadIndexedAddress(uint64_t index) const;
+  uint64_t ReadRangeListOffset(uint64_t index) const;
+  uint64_t ReadLocationListOffset(uint64_t index) const;
+
+  // True while we are looking for the unit's base attributes, which may
+  // come after attributes that need them.  In the meantime index forms
+  // can't be resolved and strings aren't reported.
+  bool reading_unit_bases() const { return reading_unit_bases_; }
+
+  // Lets this reader use the abbreviation tables that |other| has already
+  // read, instead of reading them again.  |other| must outlive this reader and
+  // must not read any more units while this reader is in use, but several
+  // readers (even on different threads) may share the same |other|.
+  void ShareAbbrevTables(const DIEReader& other) {
+    shared_abbrev_tables_ = &other.abbrev_tables_;
+  }
 
   // If both compileunit_name and strp_sink are set, this will automatically
   // call strp_sink->AddFileRange(compileunit_name, <string range>) for every
-  // DW_FORM_strp attribute encountered.  These strings occur in the .debug_str
-  // section.
+  // DW_FORM_strp, DW_FORM_strx* or DW_FORM_line_strp attribute encountered.
+  // These strings occur in the .debug_str and .debug_line_str sections.
   void set_compileunit_name(absl::string_view name) {
     unit_name_ = std::string(name);
   }
   void set_strp_sink(RangeSink* sink) { strp_sink_ = sink; }
 
   void AddIndirectString(string_view range) const {
-    if (strp_sink_) {
+    if (strp_sink_ && !reading_unit_bases_ && !skipping_children_) {
       strp_sink_->AddFileRange("dwarf_strp", unit_name_, range);
     }
   }
@@ -642,6 +884,9 @@ class DIEReader {
 
   bool ReadCompilationUnitHeader();
   bool ReadCode();
+  void ReadUnitBases();
+  uint64_t ReadListOffset(string_view section, absl::optional<uint64_t> base,
+                          uint64_t index) const;
 
   enum class State {
     kReadyToReadAttributes,
@@ -654,6 +899,9 @@ class DIEReader {
   const File& dwarf_;
   RangeSink* strp_sink_ = nullptr;
 
+  // Used by SkipChildren() for descendants that it has to decode.
+  std::unique_ptr<AttrReader<void>> skip_reader_;
+
   // Abbreviation for the current entry.
   const AbbrevTable::Abbrev* current_abbrev_;
 
@@ -668,6 +916,8 @@ class DIEReader {
   // All of the AbbrevTables we've read from .debug_abbrev, indexed by their
   // offset within .debug_abbrev.
   std::unordered_map<uint64_t, AbbrevTable> abbrev_tables_;
+  const std::unordered_map<uint64_t, AbbrevTable>* shared_abbrev_tables_ =
+      nullptr;
 
   // Whether we are in .debug_types or .debug_info.
   Section section_;
@@ -677,7 +927,7 @@ class DIEReader {
   std::string unit_name_;
   string_view unit_range_;
   CompilationUnitSizes unit_sizes_;
-  AbbrevTable* unit_abbrev_;
+  const AbbrevTable* unit_abbrev_;
 
   // A small integer that uniquely identifies the combination of unit_abbrev_
   // and unit_sizes_.  Attribute readers use this to know when they can reuse an
@@ -685,12 +935,21 @@ class DIEReader {
   // both the current abbrev. table and the sizes.
   uint32_t abbrev_version_;
 
-  std::map<std::pair<AbbrevTable*, CompilationUnitSizes>, uint32_t>
+  std::map<std::pair<const AbbrevTable*, CompilationUnitSizes>, uint32_t>
       abbrev_versions_;
 
-  // Only for .debug_types
+  // Only for .debug_types, or DWARF 5 type units.
   uint64_t unit_type_signature_;
   uint64_t unit_type_offset_;
+
+  // Only for DWARF 5.
+  uint8_t unit_type_;
+  absl::optional<uint64_t> unit_dwo_id_;
+  UnitBases unit_bases_;
+  bool reading_unit_bases_ = false;
+  bool skipping_children_ = false;
+
+  absl::optional<uint64_t> skeleton_addr_base_;
 };
 
 bool DIEReader::ReadCode() {
@@ -758,27 +1017,65 @@ bool DIEReader::ReadCompilationUnitHeader() {
       0, remaining_.size() + (remaining_.data() - unit_range_.data()));
 
   unit_sizes_.ReadDWARFVersion(&remaining_);
+  unit_dwo_id_.reset();
 
-  if (unit_sizes_.dwarf_version() > 4) {
+  if (unit_sizes_.dwarf_version() > 5) {
     THROW("Data is in new DWARF format we don't understand");
   }
 
-  debug_abbrev_offset_ = unit_sizes_.ReadDWARFOffset(&remaining_);
-  unit_abbrev_ = &abbrev_tables_[debug_abbrev_offset_];
+  if (unit_sizes_.dwarf_version() == 5) {
+    // DWARF 5 moved the address size before the abbreviation offset, and the
+    // unit type (rather than the section) says what comes next.
+    unit_type_ = ReadMemcpy<uint8_t>(&remaining_);
+    unit_sizes_.SetAddressSize(ReadMemcpy<uint8_t>(&remaining_));
+    debug_abbrev_offset_ = unit_sizes_.ReadDWARFOffset(&remaining_);
 
-  // If we haven't already read abbreviations for this debug_abbrev_offset_, we
-  // need to do so now.
-  if (unit_abbrev_->IsEmpty()) {
-    string_view abbrev_data = dwarf_.debug_abbrev;
-    SkipBytes(debug_abbrev_offset_, &abbrev_data);
-    unit_abbrev_->ReadAbbrevs(abbrev_data);
+    switch (unit_type_) {
+      case DW_UT_compile:
+      case DW_UT_partial:
+        break;
+      case DW_UT_skeleton:
+      case DW_UT_split_compile:
+        unit_dwo_id_ = ReadMemcpy<uint64_t>(&remaining_);
+        break;
+      case DW_UT_type:
+      case DW_UT_split_type:
+        unit_type_signature_ = ReadMemcpy<uint64_t>(&remaining_);
+        unit_type_offset_ = unit_sizes_.ReadDWARFOffset(&remaining_);
+        break;
+      default:
+        THROWF("unknown DWARF unit type: $0", unit_type_);
+    }
+  } else {
+    debug_abbrev_offset_ = unit_sizes_.ReadDWARFOffset(&remaining_);
+    unit_sizes_.SetAddressSize(ReadMemcpy<uint8_t>(&remaining_));
+
+    if (section_ == Section::kDebugTypes) {
+      unit_type_signature_ = ReadMemcpy<uint64_t>(&remaining_);
+      unit_type_offset_ = unit_sizes_.ReadDWARFOffset(&remaining_);
+    }
   }
 
-  unit_sizes_.SetAddressSize(ReadMemcpy<uint8_t>(&remaining_));
+  unit_abbrev_ = nullptr;
 
-  if (section_ == Section::kDebugTypes) {
-    unit_type_signature_ = ReadMemcpy<uint64_t>(&remaining_);
-    unit_type_offset_ = unit_sizes_.ReadDWARFOffset(&remaining_);
+  if (shared_abbrev_tables_) {
+    auto it = shared_abbrev_tables_->find(debug_abbrev_offset_);
+    if (it != shared_abbrev_tables_->end() && !it->second.IsEmpty()) {
+      unit_abbrev_ = &it->second;
+    }
+  }
+
+  if (!unit_abbrev_) {
+    AbbrevTable* table = &abbrev_tables_[debug_abbrev_offset_];
+
+    // If we haven't already read abbreviations for this debug_abbrev_offset_,
+    // we need to do so now.
+    if (table->IsEmpty()) {
+      string_view abbrev_data = dwarf_.debug_abbrev;
+      SkipBytes(debug_abbrev_offset_, &abbrev_data);
+      table->ReadAbbrevs(abbrev_data);
+    }
+    unit_abbrev_ = table;
   }
 
   auto abbrev_id = std::make_pair(unit_abbrev_, unit_sizes_);
@@ -788,8 +1085,58 @@ bool DIEReader::ReadCompilationUnitHeader() {
   // This will be either the newly inserted value or the existing one, if there
   // was one.
   abbrev_version_ = insert_pair.first->second;
+  unit_bases_ = UnitBases();
+  unit_bases_.addr = skeleton_addr_base_;
 
-  return ReadCode();
+  if (!ReadCode()) {
+    return false;
+  }
+
+  if (unit_sizes_.dwarf_version() >= 5) {
+    ReadUnitBases();
+  }
+
+  return true;
+}
+
+string_view DIEReader::ReadIndexedString(uint64_t index) const {
+  uint64_t base = unit_bases_.str_offsets.value_or(
+      unit_sizes_.dwarf_version() >= 5
+          ? TableHeaderSize(unit_sizes_, kStrOffsetsHeaderSize)
+          : 0);
+  string_view entry =
+      ReadTableEntry(dwarf_.debug_str_offsets, base, index,
+                     unit_sizes_.dwarf64() ? 8 : 4);
+  StringTable table(dwarf_.debug_str);
+  return table.ReadEntry(unit_sizes_.ReadDWARFOffset(&entry));
+}
+
+uint64_t DIEReader::ReadIndexedAddress(uint64_t index) const {
+  uint64_t base = unit_bases_.addr.value_or(
+      unit_sizes_.dwarf_version() >= 5
+          ? TableHeaderSize(unit_sizes_, kAddrHeaderSize)
+          : 0);
+  string_view entry = ReadTableEntry(dwarf_.debug_addr, base, index,
+                                     unit_sizes_.address_size());
+  return unit_sizes_.ReadAddress(&entry);
+}
+
+// The offsets in a range or location list table are relative to the base.
+uint64_t DIEReader::ReadListOffset(string_view section,
+                                   absl::optional<uint64_t> base,
+                                   uint64_t index) const {
+  uint64_t ofs = base.value_or(TableHeaderSize(unit_sizes_, kListsHeaderSize));
+  string_view entry =
+      ReadTableEntry(section, ofs, index, unit_sizes_.dwarf64() ? 8 : 4);
+  return ofs + unit_sizes_.ReadDWARFOffset(&entry);
+}
+
+uint64_t DIEReader::ReadRangeListOffset(uint64_t index) const {
+  return ReadListOffset(dwarf_.debug_rnglists, unit_bases_.rnglists, index);
+}
+
+uint64_t DIEReader::ReadLocationListOffset(uint64_t index) const {
+  return ReadListOffset(dwarf_.debug_loclists, unit_bases_.loclists, index);
 }
 
 
@@ -856,15 +1203,44 @@ string_view ReadVariableBlock(string_view* data) {
 }
 
 template <class D>
-string_view ReadIndirectString(const DIEReader& reader, string_view* data) {
+string_view ReadIndirectString(const DIEReader& reader, string_view section,
+                               string_view* data) {
   D ofs = ReadMemcpy<D>(data);
-  StringTable table(reader.dwarf().debug_str);
+  StringTable table(section);
   string_view ret = table.ReadEntry(ofs);
   reader.AddIndirectString(ret);
   return ret;
 }
 
-AttrValue ParseAttr(const DIEReader& reader, uint8_t form, string_view* data) {
+// Parses the DWARF 5 forms that hold an index into one of the unit's tables,
+// and the GNU forms that split DWARF used for the same thing before DWARF 5.
+AttrValue ParseIndexedAttr(const DIEReader& reader, uint16_t form,
+                           uint64_t index) {
+  if (reader.reading_unit_bases()) {
+    return AttrValue(index);
+  }
+
+  switch (form) {
+    case DW_FORM_strx:
+    case DW_FORM_strx1:
+    case DW_FORM_strx2:
+    case DW_FORM_strx3:
+    case DW_FORM_strx4:
+    case DW_FORM_GNU_str_index: {
+      string_view str = reader.ReadIndexedString(index);
+      reader.AddIndirectString(str);
+      return AttrValue(str);
+    }
+    case DW_FORM_rnglistx:
+      return AttrValue(reader.ReadRangeListOffset(index));
+    case DW_FORM_loclistx:
+      return AttrValue(reader.ReadLocationListOffset(index));
+    default:
+      return AttrValue(reader.ReadIndexedAddress(index));
+  }
+}
+
+AttrValue ParseAttr(const DIEReader& reader, uint16_t form, string_view* data) {
   switch (form) {
     case DW_FORM_indirect: {
       uint16_t indirect_form = ReadLEB128<uint16_t>(data);
@@ -920,10 +1296,48 @@ AttrValue ParseAttr(const DIEReader& reader, uint8_t form, string_view* data) {
       return AttrValue(ReadNullTerminated(data));
     case DW_FORM_strp:
       if (reader.unit_sizes().dwarf64()) {
-        return AttrValue(ReadIndirectString<uint64_t>(reader, data));
+        return AttrValue(ReadIndirectString<uint64_t>(
+            reader, reader.dwarf().debug_str, data));
+      } else {
+        return AttrValue(ReadIndirectString<uint32_t>(
+            reader, reader.dwarf().debug_str, data));
+      }
+    case DW_FORM_line_strp:
+      if (reader.unit_sizes().dwarf64()) {
+        return AttrValue(ReadIndirectString<uint64_t>(
+            reader, reader.dwarf().debug_line_str, data));
       } else {
-        return AttrValue(ReadIndirectString<uint32_t>(reader, data));
+        return AttrValue(ReadIndirectString<uint32_t>(
+            reader, reader.dwarf().debug_line_str, data));
       }
+    case DW_FORM_strx:
+    case DW_FORM_addrx:
+    case DW_FORM_rnglistx:
+    case DW_FORM_loclistx:
+    case DW_FORM_GNU_addr_index:
+    case DW_FORM_GNU_str_index:
+      return ParseIndexedAttr(reader, form, ReadLEB128<uint64_t>(data));
+    case DW_FORM_strx1:
+    case DW_FORM_addrx1:
+      return ParseIndexedAttr(reader, form, ReadMemcpy<uint8_t>(data));
+    case DW_FORM_strx2:
+    case DW_FORM_addrx2:
+      return ParseIndexedAttr(reader, form, ReadMemcpy<uint16_t>(data));
+    case DW_FORM_strx3:
+    case DW_FORM_addrx3:
+      return ParseIndexedAttr(reader, form, ReadUint24(data));
+    case DW_FORM_strx4:
+    case DW_FORM_addrx4:
+      return ParseIndexedAttr(reader, form, ReadMemcpy<uint32_t>(data));
+
+    // These refer to a supplementary object file, which we don't read.
+    case DW_FORM_ref_sup4:
+      return AttrValue(ReadMemcpy<uint32_t>(data));
+    case DW_FORM_ref_sup8:
+      return AttrValue(ReadMemcpy<uint64_t>(data));
+    case DW_FORM_strp_sup:
+      return AttrValue(reader.unit_sizes().ReadDWARFOffset(data));
+
     case DW_FORM_data1:
       return AttrValue(ReadPiece(1, data));
     case DW_FORM_data2:
@@ -932,6 +1346,8 @@ AttrValue ParseAttr(const DIEReader& reader, uint8_t form, string_view* data) {
       return AttrValue(ReadPiece(4, data));
     case DW_FORM_data8:
       return AttrValue(ReadPiece(8, data));
+    case DW_FORM_data16:
+      return AttrValue(ReadPiece(16, data));
 
     // Bloaty doesn't currently care about any bool or signed data.
     // So we fudge it a bit and just stuff these in a uint64.
@@ -941,11 +1357,121 @@ AttrValue ParseAttr(const DIEReader& reader, uint8_t form, string_view* data) {
       return AttrValue(ReadMemcpy<uint8_t>(data));
     case DW_FORM_sdata:
       return AttrValue(ReadLEB128<uint64_t>(data));
+    case DW_FORM_implicit_const:
+      // The value is in the abbreviation, so our callers handle this form.
+      THROW("DW_FORM_implicit_const can't be used indirectly");
     default:
       THROWF("Don't know how to parse DWARF form: $0", form);
   }
 }
 
+// From DIEReader, defined here because it depends on ParseAttr().
+void DIEReader::ReadUnitBases() {
+  string_view data = remaining_;
+  reading_unit_bases_ = true;
+
+  for (const AbbrevTable::Attribute& attr : GetAbbrev().attr) {
+    if (attr.form == DW_FORM_implicit_const) {
+      continue;
+    }
+
+    AttrValue value = ParseAttr(*this, attr.form, &data);
+    switch (attr.name) {
+      case DW_AT_str_offsets_base:
+        unit_bases_.str_offsets = value.ToUint();
+        break;
+      case DW_AT_addr_base:
+        unit_bases_.addr = value.ToUint();
+        break;
+      case DW_AT_rnglists_base:
+        unit_bases_.rnglists = value.ToUint();
+        break;
+      case DW_AT_loclists_base:
+        unit_bases_.loclists = value.ToUint();
+        break;
+    }
+  }
+
+  reading_unit_bases_ = false;
+}
+
+// Returns true for the forms that reference another DIE in the same unit.
+bool IsUnitReferenceForm(uint16_t form) {
+  switch (form) {
+    case DW_FORM_ref1:
+    case DW_FORM_ref2:
+    case DW_FORM_ref4:
+    case DW_FORM_ref8:
+    case DW_FORM_ref_udata:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Returns true for the forms whose value is a single LEB128 number.
+bool IsLEB128Form(uint16_t form) {
+  switch (form) {
+    case DW_FORM_udata:
+    case DW_FORM_sdata:
+    case DW_FORM_ref_udata:
+    case DW_FORM_addrx:
+    case DW_FORM_rnglistx:
+    case DW_FORM_loclistx:
+    case DW_FORM_GNU_addr_index:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Returns the number of bytes an attribute of this form occupies in a unit with
+// these sizes, or -1 if the size depends on the data or the attribute has to
+// be parsed anyway (the string forms, whose strings we report to the strp
+// sink).
+int FixedFormSize(CompilationUnitSizes sizes, uint16_t form) {
+  switch (form) {
+    case DW_FORM_flag_present:
+    case DW_FORM_implicit_const:
+      return 0;
+    case DW_FORM_ref1:
+    case DW_FORM_data1:
+    case DW_FORM_flag:
+    case DW_FORM_addrx1:
+      return 1;
+    case DW_FORM_ref2:
+    case DW_FORM_data2:
+    case DW_FORM_addrx2:
+      return 2;
+    case DW_FORM_addrx3:
+      return 3;
+    case DW_FORM_ref4:
+    case DW_FORM_data4:
+    case DW_FORM_addrx4:
+    case DW_FORM_ref_sup4:
+      return 4;
+    case DW_FORM_ref_sig8:
+    case DW_FORM_ref8:
+    case DW_FORM_data8:
+    case DW_FORM_ref_sup8:
+      return 8;
+    case DW_FORM_data16:
+      return 16;
+    case DW_FORM_addr:
+      return sizes.address_size();
+    case DW_FORM_ref_addr:
+      if (sizes.dwarf_version() <= 2) {
+        return sizes.address_size();
+      }
+      ABSL_FALLTHROUGH_INTENDED;
+    case DW_FORM_sec_offset:
+    case DW_FORM_strp_sup:
+      return sizes.dwarf64() ? 8 : 4;
+    default:
+      return -1;
+  }
+}
+
 
 // AttrReader //////////////////////////////////////////////////////////////////
 
@@ -958,46 +1484,206 @@ class AttrReader {
 
   void OnAttribute(DwarfAttribute attr, CallbackFunc* func) {
     attributes_[attr] = func;
+    actions_.clear();
   }
 
   // Reads all attributes for this DIE, storing the ones we were expecting.
   void ReadAttributes(DIEReader* reader, T* container) {
     string_view data = reader->ReadAttributesBegin();
-    const AbbrevTable::Abbrev& abbrev = reader->GetAbbrev();
+    const Actions& actions = GetActions(*reader);
+    uint64_t sibling = 0;
 
-    for (auto attr : abbrev.attr) {
-      AttrValue value = ParseAttr(*reader, attr.form, &data);
-      auto it = attributes_.find(attr.name);
-      if (it != attributes_.end()) {
-        it->second(container, value);
+    for (const Action& action : actions.actions) {
+      SkipBytes(action.skip, &data);
+      if (action.leb128s) {
+        SkipLEB128s(action.leb128s, &data);
+      }
+      if (action.form == 0) {
+        continue;
+      }
+      AttrValue value = action.form == DW_FORM_implicit_const
+                            ? AttrValue(action.implicit_const)
+                            : ParseAttr(*reader, action.form, &data);
+      if (action.is_sibling) {
+        sibling = value.GetUint();
+      }
+      if (action.func) {
+        action.func(container, value);
       }
     }
 
-    reader->ReadAttributesEnd(data, 0);
+    reader->ReadAttributesEnd(data, sibling);
   }
 
  private:
+  // Skips |skip| bytes and then |leb128s| LEB128 values of attributes that we
+  // don't care about, then parses one attribute of |form| (unless it is zero)
+  // and passes it to |func|, if any.  |is_sibling| marks a DW_AT_sibling
+  // reference, which we hand to the DIEReader.  DW_FORM_implicit_const
+  // attributes take their value from |implicit_const| instead.
+  struct Action {
+    size_t skip;
+    uint32_t leb128s;
+    uint16_t form;
+    bool is_sibling;
+    CallbackFunc* func;
+    uint64_t implicit_const;
+  };
+
+  // How to read all of the attributes of one abbreviation.  Attributes that
+  // we have no callback for and whose size is fixed (for the unit's sizes) are
+  // folded into the skips, so a run of them costs a single pointer bump.
+  // Runs of LEB128 attributes that we have no callback for are skipped
+  // together too.
+  struct Actions {
+    bool compiled = false;
+    std::vector<Action> actions;
+  };
+
+  // Returns the actions for the reader's current abbreviation, compiling them
+  // the first time the abbreviation is seen with these unit sizes.
+  const Actions& GetActions(const DIEReader& reader) {
+    // Abbreviation versions are only meaningful within a single DIEReader.
+    if (&reader != reader_) {
+      actions_.clear();
+      reader_ = &reader;
+    }
+
+    uint32_t version = reader.abbrev_version();
+    if (version >= actions_.size()) {
+      actions_.resize(version + 1);
+    }
+
+    const AbbrevTable::Abbrev& abbrev = reader.GetAbbrev();
+    std::vector<Actions>& by_index = actions_[version];
+    if (by_index.empty()) {
+      by_index.resize(reader.unit_abbrev().size());
+    }
+
+    Actions& actions = by_index[abbrev.index];
+    if (!actions.compiled) {
+      actions = CompileActions(reader.unit_sizes(), abbrev);
+    }
+    return actions;
+  }
+
+  Actions CompileActions(CompilationUnitSizes sizes,
+                         const AbbrevTable::Abbrev& abbrev) const {
+    Actions ret;
+    Action pending{};
+    ret.compiled = true;
+
+    for (const auto& attr : abbrev.attr) {
+      auto it = attributes_.find(attr.name);
+      CallbackFunc* func = it == attributes_.end() ? nullptr : it->second;
+      bool is_sibling =
+          attr.name == DW_AT_sibling && IsUnitReferenceForm(attr.form);
+
+      if (!func && !is_sibling) {
+        int size = FixedFormSize(sizes, attr.form);
+        if (size >= 0) {
+          // Fixed skips come before LEB128 skips within an action.
+          if (pending.leb128s > 0) {
+            ret.actions.push_back(pending);
+            pending = Action{};
+          }
+          pending.skip += size;
+          continue;
+        } else if (IsLEB128Form(attr.form)) {
+          pending.leb128s++;
+          continue;
+        }
+      }
+
+      pending.form = attr.form;
+      pending.is_sibling = is_sibling;
+      pending.func = func;
+      pending.implicit_const = attr.implicit_const;
+      ret.actions.push_back(pending);
+      pending = Action{};
+    }
+
+    if (pending.skip > 0 || pending.leb128s > 0) {
+      ret.actions.push_back(pending);
+    }
+    return ret;
+  }
+
   std::unordered_map<int, CallbackFunc*> attributes_;
+
+  // Compiled actions, indexed by the reader's abbrev_version() and then by
+  // the abbreviation's index in its table.
+  const DIEReader* reader_ = nullptr;
+  std::vector<std::vector<Actions>> actions_;
 };
 
-// From DIEReader, defined here because it depends on FixedAttrReader.
+// From DIEReader, defined here because they depend on AttrReader.
+DIEReader::DIEReader(const File& file)
+    : dwarf_(file), skip_reader_(new AttrReader<void>()) {}
+
+DIEReader::~DIEReader() {}
+
 bool DIEReader::SkipChildren() {
   assert(state_ == State::kReadyToNext);
   if (!HasChild()) {
     return true;
   }
 
-  int target_depth = depth_ - 1;
-  dwarf::AttrReader<void> attr_reader;
-  while (depth_ > target_depth) {
-    // TODO(haberman): use DW_AT_sibling to optimize skipping when it is
-    // available.
-    if (!NextDIE()) {
-      return false;
+  const int target_depth = depth_ - 1;
+  const char* start = remaining_.data();
+  uint64_t sibling_skipped = 0;
+  bool ok = true;
+
+  // Decoding a descendant must not attribute its strings to the unit, since
+  // jumping over it with DW_AT_sibling wouldn't.
+  skipping_children_ = true;
+
+  while (true) {
+    // The current DIE's children come next.  DW_AT_sibling is the offset of
+    // the DIE after them, relative to the unit header.
+    uint64_t offset = remaining_.data() - unit_range_.data();
+    if (HasChild() && sibling_offset_ > offset &&
+        sibling_offset_ <= unit_range_.size()) {
+      sibling_skipped += sibling_offset_ - offset;
+      remaining_ = unit_range_.substr(sibling_offset_);
+      depth_--;
+    }
+
+    // Consume null entries until we are back at our own depth (which leaves
+    // the next call to NextDIE() at our sibling) or find another descendant.
+    uint32_t code = 0;
+    while (depth_ > target_depth) {
+      if (remaining_.empty()) {
+        state_ = State::kEof;
+        ok = false;
+        break;
+      }
+      code = ReadLEB128<uint32_t>(&remaining_);
+      if (code != 0) {
+        break;
+      }
+      depth_--;
+    }
+
+    if (!ok || depth_ <= target_depth) {
+      break;
     }
-    attr_reader.ReadAttributes(this, nullptr);
+
+    if (!unit_abbrev_->GetAbbrev(code, &current_abbrev_)) {
+      THROW("couldn't find abbreviation for code");
+    }
+    state_ = State::kReadyToReadAttributes;
+    sibling_offset_ = 0;
+    if (HasChild()) {
+      depth_++;
+    }
+    skip_reader_->ReadAttributes(this, nullptr);
   }
-  return true;
+
+  skipping_children_ = false;
+  skipped_die_bytes += remaining_.data() - start;
+  sibling_skipped_die_bytes += sibling_skipped;
+  return ok;
 }
 
 // LineInfoReader //////////////////////////////////////////////////////////////
@@ -1031,6 +1717,14 @@ class LineInfoReader {
     uint64_t file_size;
   };
 
+  // If set, strings that the header refers to in .debug_str or
+  // .debug_line_str (as DWARF 5 line tables do) are reported to |sink| under
+  // |name|.
+  void set_strp_sink(RangeSink* sink, string_view name) {
+    strp_sink_ = sink;
+    strp_name_ = std::string(name);
+  }
+
   void SeekToOffset(uint64_t offset, uint8_t address_size);
   bool ReadLineInfo();
   const LineInfo& lineinfo() const { return info_; }
@@ -1062,6 +1756,21 @@ class LineInfoReader {
     return ret;
   }
 
+  // Returns a number for the expanded filename of the file at |index|, which
+  // is the same for two indexes only if they have the same filename.  A table
+  // can list a file more than once: DWARF 5 tables list the primary source
+  // file as both file 0 and file 1.
+  uint32_t GetFilenameId(size_t index) {
+    if (index < filename_ids_.size() && filename_ids_[index] != UINT32_MAX) {
+      return filename_ids_[index];
+    }
+    const std::string& name = GetExpandedFilename(index);
+    filename_ids_.resize(filenames_.size(), UINT32_MAX);
+    uint32_t id = filename_id_map_.emplace(name, index).first->second;
+    filename_ids_[index] = id;
+    return id;
+  }
+
  private:
   struct Params {
     uint8_t minimum_instruction_length;
@@ -1073,12 +1782,16 @@ class LineInfoReader {
   } params_;
 
   const File& file_;
+  RangeSink* strp_sink_ = nullptr;
+  std::string strp_name_;
 
   CompilationUnitSizes sizes_;
   std::vector<string_view> include_directories_;
   std::vector<FileName> filenames_;
   std::vector<uint8_t> standard_opcode_lengths_;
   std::vector<std::string> expanded_filenames_;
+  std::vector<uint32_t> filename_ids_;
+  std::unordered_map<std::string, uint32_t> filename_id_map_;
 
   string_view remaining_;
 
@@ -1113,6 +1826,9 @@ class LineInfoReader {
 
   uint8_t AdjustedOpcode(uint8_t op) { return op - params_.opcode_base; }
 
+  void ReadEntriesV5(string_view* data, bool is_file);
+  AttrValue ReadEntryValue(uint16_t form, string_view* data);
+
   void SpecialOpcodeAdvance(uint8_t op) {
     Advance(AdjustedOpcode(op) / params_.line_range);
   }
@@ -1125,12 +1841,20 @@ void LineInfoReader::SeekToOffset(uint64_t offset, uint8_t address_size) {
   sizes_.SetAddressSize(address_size);
   data = sizes_.ReadInitialLength(&data);
   sizes_.ReadDWARFVersion(&data);
+
+  if (sizes_.dwarf_version() >= 5) {
+    sizes_.SetAddressSize(ReadMemcpy<uint8_t>(&data));
+    if (ReadMemcpy<uint8_t>(&data) != 0) {
+      THROW("we don't know how to handle segmented addresses.");
+    }
+  }
+
   uint64_t header_length = sizes_.ReadDWARFOffset(&data);
   string_view program = data;
   SkipBytes(header_length, &program);
 
   params_.minimum_instruction_length = ReadMemcpy<uint8_t>(&data);
-  if (sizes_.dwarf_version() == 4) {
+  if (sizes_.dwarf_version() >= 4) {
     params_.maximum_operations_per_instruction = ReadMemcpy<uint8_t>(&data);
 
     if (params_.maximum_operations_per_instruction == 0) {
@@ -1152,8 +1876,22 @@ void LineInfoReader::SeekToOffset(uint64_t offset, uint8_t address_size) {
     standard_opcode_lengths_[i] = ReadMemcpy<uint8_t>(&data);
   }
 
-  // Read include_directories.
   include_directories_.clear();
+  filenames_.clear();
+  expanded_filenames_.clear();
+  filename_ids_.clear();
+  filename_id_map_.clear();
+
+  if (sizes_.dwarf_version() >= 5) {
+    ReadEntriesV5(&data, false);
+    ReadEntriesV5(&data, true);
+    info_ = LineInfo(params_.default_is_stmt);
+    remaining_ = program;
+    shadow_ = false;
+    return;
+  }
+
+  // Read include_directories.
 
   // Implicit current directory entry.
   include_directories_.push_back(string_view());
@@ -1167,8 +1905,6 @@ void LineInfoReader::SeekToOffset(uint64_t offset, uint8_t address_size) {
   }
 
   // Read file_names.
-  filenames_.clear();
-  expanded_filenames_.clear();
 
   // Filename 0 is unused.
   filenames_.push_back(FileName());
@@ -1192,6 +1928,94 @@ void LineInfoReader::SeekToOffset(uint64_t offset, uint8_t address_size) {
   shadow_ = false;
 }
 
+// DWARF 5 describes the fields of each directory and file name entry with a
+// list of (content type, form) pairs, which comes before the entries.
+void LineInfoReader::ReadEntriesV5(string_view* data, bool is_file) {
+  std::vector<std::pair<uint16_t, uint16_t>> formats;
+  uint8_t format_count = ReadMemcpy<uint8_t>(data);
+  for (uint8_t i = 0; i < format_count; i++) {
+    uint16_t content_type = ReadLEB128<uint16_t>(data);
+    uint16_t form = ReadLEB128<uint16_t>(data);
+    formats.emplace_back(content_type, form);
+  }
+
+  uint64_t count = ReadLEB128<uint64_t>(data);
+  if (count > 0 && formats.empty()) {
+    THROW("DWARF line table entries have no fields");
+  }
+
+  for (uint64_t i = 0; i < count; i++) {
+    FileName file_name = FileName();
+    for (const auto& format : formats) {
+      AttrValue value = ReadEntryValue(format.second, data);
+      switch (format.first) {
+        case DW_LNCT_path:
+          if (!value.IsString()) {
+            THROW("DWARF line table path is not a string");
+          }
+          file_name.name = value.GetString();
+          break;
+        case DW_LNCT_directory_index:
+          file_name.directory_index = value.ToUint().value_or(UINT32_MAX);
+          break;
+        case DW_LNCT_timestamp:
+          file_name.modified_time = value.ToUint().value_or(0);
+          break;
+        case DW_LNCT_size:
+          file_name.file_size = value.ToUint().value_or(0);
+          break;
+      }
+    }
+
+    if (!is_file) {
+      // Directory 0 is the compilation directory, which earlier versions
+      // left implicit.  We leave it out of the names, as before.
+      include_directories_.push_back(i == 0 ? string_view() : file_name.name);
+    } else if (file_name.directory_index >= include_directories_.size()) {
+      THROW("directory index out of range");
+    } else {
+      filenames_.push_back(file_name);
+    }
+  }
+}
+
+AttrValue LineInfoReader::ReadEntryValue(uint16_t form, string_view* data) {
+  string_view section;
+  switch (form) {
+    case DW_FORM_string:
+      return AttrValue(ReadNullTerminated(data));
+    case DW_FORM_line_strp:
+      section = file_.debug_line_str;
+      break;
+    case DW_FORM_strp:
+      section = file_.debug_str;
+      break;
+    case DW_FORM_udata:
+      return AttrValue(ReadLEB128<uint64_t>(data));
+    case DW_FORM_data1:
+      return AttrValue(ReadMemcpy<uint8_t>(data));
+    case DW_FORM_data2:
+      return AttrValue(ReadMemcpy<uint16_t>(data));
+    case DW_FORM_data4:
+      return AttrValue(ReadMemcpy<uint32_t>(data));
+    case DW_FORM_data8:
+      return AttrValue(ReadMemcpy<uint64_t>(data));
+    case DW_FORM_data16:
+      return AttrValue(ReadPiece(16, data));
+    case DW_FORM_block:
+      return AttrValue(ReadVariableBlock(data));
+    default:
+      THROWF("Don't know how to parse DWARF line table form: $0", form);
+  }
+
+  StringTable table(section);
+  string_view str = table.ReadEntry(sizes_.ReadDWARFOffset(data));
+  if (strp_sink_) {
+    strp_sink_->AddFileRange("dwarf_strp", strp_name_, str);
+  }
+  return AttrValue(str);
+}
+
 bool LineInfoReader::ReadLineInfo() {
   // Final step of last DW_LNS_copy / special opcode.
   info_.discriminator = 0;
@@ -1329,6 +2153,197 @@ bool LineInfoReader::ReadLineInfo() {
   }
 }
 
+// Split DWARF /////////////////////////////////////////////////////////////////
+
+// With -gsplit-dwarf, each compilation unit in a binary is reduced to a
+// skeleton: a first DIE with little more than the unit's address range, its
+// line table, and a DWO ID.  The rest of the unit is a split unit with the
+// same DWO ID, in a .dwo file of its own or in a .dwp package that combines
+// many .dwo files.  A package has an index, .debug_cu_index, of each unit's
+// part of each of the package's sections.
+
+// A split unit, and its part of the sections of its .dwo or .dwp file.  It
+// also uses the .debug_addr of the binary, which SplitSections() adds when a
+// binary reads it.
+struct SplitUnit {
+  const File* sections;
+  uint64_t header_offset;  // Within sections->debug_info.
+};
+
+class SplitUnitIndex {
+ public:
+  // Finds the units in |files|, reading the files in parallel.
+  explicit SplitUnitIndex(const SplitFiles& files);
+
+  // Returns the split unit with this DWO ID, or null if there isn't one.
+  const SplitUnit* Find(uint64_t dwo_id) const {
+    auto it = units_.find(dwo_id);
+    return it == units_.end() ? nullptr : &it->second;
+  }
+
+ private:
+  BLOATY_DISALLOW_COPY_AND_ASSIGN(SplitUnitIndex);
+
+  // The units found in one file, keyed by DWO ID.
+  struct FileUnits {
+    std::vector<std::unique_ptr<File>> sections;
+    std::vector<std::pair<uint64_t, SplitUnit>> units;
+  };
+
+  static void ReadDwo(const File& file, FileUnits* out);
+  static void ReadPackage(const File& file, FileUnits* out);
+
+  std::vector<FileUnits> files_;
+  std::unordered_map<uint64_t, SplitUnit> units_;
+};
+
+// Returns the sections of |file| that split units use, without owning them,
+// along with |debug_addr| from the binary that has the skeleton units.
+std::unique_ptr<File> SplitSections(const File& file, string_view debug_addr) {
+  std::unique_ptr<File> ret(new File);
+  ret->debug_info = file.debug_info;
+  ret->debug_types = file.debug_types;
+  ret->debug_str = file.debug_str;
+  ret->debug_abbrev = file.debug_abbrev;
+  ret->debug_line = file.debug_line;
+  ret->debug_loc = file.debug_loc;
+  ret->debug_str_offsets = file.debug_str_offsets;
+  ret->debug_rnglists = file.debug_rnglists;
+  ret->debug_loclists = file.debug_loclists;
+  ret->debug_addr = debug_addr;
+  return ret;
+}
+
+// Returns the section of |file| that a column of a package index is for, or
+// null if we don't read it.  Version 2 is the GNU package format that came
+// before DWARF 5, which numbered some of the sections differently.
+string_view* GetPackageSection(uint32_t version, uint32_t id, File* file) {
+  switch (id) {
+    case DW_SECT_INFO:
+      return &file->debug_info;
+    case DW_SECT_ABBREV:
+      return &file->debug_abbrev;
+    case DW_SECT_LINE:
+      return &file->debug_line;
+    case DW_SECT_STR_OFFSETS:
+      return &file->debug_str_offsets;
+    case DW_SECT_LOC:  // DW_SECT_LOCLISTS in version 5.
+      return version >= 5 ? &file->debug_loclists : &file->debug_loc;
+    case DW_SECT_MACRO:  // DW_SECT_RNGLISTS in version 5.
+      return version >= 5 ? &file->debug_rnglists : nullptr;
+    default:
+      return nullptr;
+  }
+}
+
+SplitUnitIndex::SplitUnitIndex(const SplitFiles& files)
+    : files_(files.files.size()) {
+  ParallelForEach(files.files.size(), [&](size_t i) {
+    const File& file = *files.files[i];
+    if (file.debug_cu_index.empty()) {
+      ReadDwo(file, &files_[i]);
+    } else {
+      ReadPackage(file, &files_[i]);
+    }
+  });
+
+  // If the same DWO ID turns up more than once, the first one wins.
+  for (const FileUnits& file_units : files_) {
+    for (const auto& pair : file_units.units) {
+      units_.insert(pair);
+    }
+  }
+}
+
+// A .dwo file usually has a single compilation unit, whose DWO ID is in its
+// header, or in DW_AT_GNU_dwo_id before DWARF 5.
+void SplitUnitIndex::ReadDwo(const File& file, FileUnits* out) {
+  out->sections.push_back(SplitSections(file, string_view()));
+  const File& sections = *out->sections.back();
+  DIEReader die_reader(sections);
+  AttrReader<absl::optional<uint64_t>> attr_reader;
+  attr_reader.OnAttribute(
+      DW_AT_GNU_dwo_id, [](absl::optional<uint64_t>* dwo_id, AttrValue val) {
+        *dwo_id = val.ToUint();
+      });
+
+  if (!die_reader.SeekToStart(DIEReader::Section::kDebugInfo)) {
+    return;
+  }
+
+  do {
+    absl::optional<uint64_t> dwo_id = die_reader.unit_dwo_id();
+    attr_reader.ReadAttributes(&die_reader, &dwo_id);
+    if (dwo_id.has_value() && die_reader.GetTag() == DW_TAG_compile_unit) {
+      uint64_t header_offset =
+          die_reader.unit_range().data() - sections.debug_info.data();
+      out->units.emplace_back(dwo_id.value(),
+                              SplitUnit{&sections, header_offset});
+    }
+  } while (die_reader.NextCompilationUnit());
+}
+
+// The index of a package starts with a header, followed by a hash table of
+// DWO IDs and a parallel table of row numbers.  Then comes a row of section
+// IDs, which label the columns of the last two tables: the offset and size of
+// each unit's part of each section.
+void SplitUnitIndex::ReadPackage(const File& file, FileUnits* out) {
+  string_view data = file.debug_cu_index;
+
+  // Version 2 was a 4-byte value, where DWARF 5 has 2 bytes of padding.
+  uint32_t version = ReadMemcpy<uint16_t>(&data);
+  SkipBytes(2, &data);
+  uint32_t section_count = ReadMemcpy<uint32_t>(&data);
+  uint32_t unit_count = ReadMemcpy<uint32_t>(&data);
+  uint32_t slot_count = ReadMemcpy<uint32_t>(&data);
+
+  if (version != 2 && version != 5) {
+    THROWF("unknown DWARF package index version: $0", version);
+  }
+
+  uint64_t table_size = uint64_t{unit_count} * section_count * 4;
+  string_view dwo_ids = ReadPiece(uint64_t{slot_count} * 8, &data);
+  string_view rows = ReadPiece(uint64_t{slot_count} * 4, &data);
+  string_view section_ids = ReadPiece(uint64_t{section_count} * 4, &data);
+  string_view offsets = ReadPiece(table_size, &data);
+  string_view sizes = ReadPiece(table_size, &data);
+
+  for (uint32_t i = 0; i < slot_count; i++) {
+    uint64_t dwo_id = ReadMemcpy<uint64_t>(&dwo_ids);
+    uint32_t row = ReadMemcpy<uint32_t>(&rows);
+
+    // Rows are numbered from 1, and 0 is an empty slot.
+    if (row == 0) {
+      continue;
+    } else if (row > unit_count) {
+      THROW("DWARF package index row out of range");
+    }
+
+    out->sections.push_back(SplitSections(file, string_view()));
+    File* sections = out->sections.back().get();
+    string_view ids = section_ids;
+    uint64_t row_offset = uint64_t{row - 1} * section_count * 4;
+    string_view row_offsets = offsets.substr(row_offset);
+    string_view row_sizes = sizes.substr(row_offset);
+
+    for (uint32_t j = 0; j < section_count; j++) {
+      uint32_t id = ReadMemcpy<uint32_t>(&ids);
+      uint32_t offset = ReadMemcpy<uint32_t>(&row_offsets);
+      uint32_t size = ReadMemcpy<uint32_t>(&row_sizes);
+      string_view* section = GetPackageSection(version, id, sections);
+      if (section) {
+        SkipBytes(offset, section);
+        *section = ReadPiece(size, section);
+      }
+    }
+
+    out->units.emplace_back(dwo_id, SplitUnit{sections, 0});
+  }
+}
+
+SplitFiles::SplitFiles() {}
+SplitFiles::~SplitFiles() {}
+
 }  // namespace dwarf
 
 // Bloaty DWARF Data Sources ///////////////////////////////////////////////////
@@ -1338,13 +2353,20 @@ bool LineInfoReader::ReadLineInfo() {
 // units from where that code came.  However, .debug_aranges is often incomplete
 // or missing completely, so we use it as just one of several data sources for
 // the "compileunits" data source.
-static bool ReadDWARFAddressRanges(const dwarf::File& file, RangeSink* sink) {
+//
+// |unit_names| has the names of skeleton units (by header offset), which we
+// can't find in .debug_info because they come from the split units.
+static bool ReadDWARFAddressRanges(
+    const dwarf::File& file,
+    std::unordered_map<uint64_t, std::string> unit_names, RangeSink* sink) {
   // Maps compilation unit offset -> source filename
   // Lazily initialized.
   class FilenameMap {
    public:
-    FilenameMap(const dwarf::File& file)
+    FilenameMap(const dwarf::File& file,
+                std::unordered_map<uint64_t, std::string> names)
         : die_reader_(file),
+          map_(std::move(names)),
           missing_("[DWARF is missing filename]") {
       attr_reader_.OnAttribute(
           DW_AT_name, [](string_view* s, dwarf::AttrValue data) {
@@ -1379,7 +2401,7 @@ static bool ReadDWARFAddressRanges(const dwarf::File& file, RangeSink* sink) {
     dwarf::AttrReader<string_view> attr_reader_;
     std::unordered_map<uint64_t, std::string> map_;
     std::string missing_;
-  } map(file);
+  } map(file, std::move(unit_names));
 
   dwarf::AddressRanges ranges(file.debug_aranges);
 
@@ -1410,6 +2432,8 @@ class GeneralDIE {
   bool has_stmt_list() const { return has_stmt_list_; }
   bool has_ranges() const { return has_ranges_; }
   bool has_start_scope() const { return has_start_scope_; }
+  bool has_dwo_id() const { return has_dwo_id_; }
+  bool has_addr_base() const { return has_addr_base_; }
 
   std::string DebugString() {
     std::string ret;
@@ -1440,6 +2464,12 @@ class GeneralDIE {
     if (has_start_scope()) {
       ret += absl::Substitute("start_scope: $0\n", start_scope());
     }
+    if (has_dwo_id()) {
+      ret += absl::Substitute("dwo_id: $0\n", dwo_id());
+    }
+    if (has_addr_base()) {
+      ret += absl::Substitute("addr_base: $0\n", addr_base());
+    }
     return ret;
   }
 
@@ -1452,6 +2482,8 @@ class GeneralDIE {
   uint64_t stmt_list() const { return stmt_list_; }
   uint64_t ranges() const { return ranges_; }
   uint64_t start_scope() const { return start_scope_; }
+  uint64_t dwo_id() const { return dwo_id_; }
+  uint64_t addr_base() const { return addr_base_; }
 
   void set_name(string_view val) {
     has_name_ = true;
@@ -1489,6 +2521,14 @@ class GeneralDIE {
     has_start_scope_ = true;
     start_scope_ = val;
   }
+  void set_dwo_id(uint64_t val) {
+    has_dwo_id_ = true;
+    dwo_id_ = val;
+  }
+  void set_addr_base(uint64_t val) {
+    has_addr_base_ = true;
+    addr_base_ = val;
+  }
 
  private:
   bool has_name_ = false;
@@ -1500,6 +2540,8 @@ class GeneralDIE {
   bool has_stmt_list_ = false;
   bool has_ranges_ = false;
   bool has_start_scope_ = false;
+  bool has_dwo_id_ = false;
+  bool has_addr_base_ = false;
 
   string_view name_;
   string_view linkage_name_;
@@ -1510,6 +2552,8 @@ class GeneralDIE {
   uint64_t stmt_list_ = 0;
   uint64_t ranges_ = 0;
   uint64_t start_scope_ = 0;
+  uint64_t dwo_id_ = 0;
+  uint64_t addr_base_ = 0;
 };
 
 class InlinesDIE {
@@ -1528,10 +2572,44 @@ class InlinesDIE {
   uint64_t stmt_list_ = 0;
 };
 
+// Parses a location that is just the address of a variable: DW_OP_addr, or
+// DW_OP_addrx (DW_OP_GNU_addr_index before DWARF 5) in split units.  This is a
+// very small subset of the overall DWARF expression grammar.
+static absl::optional<uint64_t> ReadLocationAddress(
+    const dwarf::DIEReader& die_reader, string_view location) {
+  dwarf::CompilationUnitSizes sizes = die_reader.unit_sizes();
+  if (location.empty()) {
+    return absl::nullopt;
+  }
+
+  uint8_t op = location[0];
+  if (op == DW_OP_addr && location.size() == sizes.address_size() + 1) {
+    location.remove_prefix(1);
+    // TODO(haberman): endian?
+    if (sizes.address_size() == 4) {
+      return dwarf::ReadMemcpy<uint32_t>(&location);
+    } else if (sizes.address_size() == 8) {
+      return dwarf::ReadMemcpy<uint64_t>(&location);
+    } else {
+      BLOATY_UNREACHABLE();
+    }
+  } else if (op == DW_OP_addrx || op == DW_OP_GNU_addr_index) {
+    location.remove_prefix(1);
+    uint64_t index = dwarf::ReadLEB128<uint64_t>(&location);
+    if (location.empty()) {
+      return die_reader.ReadIndexedAddress(index);
+    }
+  }
+
+  return absl::nullopt;
+}
+
 void AddDIE(const dwarf::File& file, const std::string& name,
             const GeneralDIE& die, const SymbolTable& symtab,
-            const DualMap& symbol_map, const dwarf::CompilationUnitSizes& sizes,
+            const DualMap& symbol_map, const dwarf::DIEReader& die_reader,
             RangeSink* sink) {
+  dwarf::CompilationUnitSizes sizes = die_reader.unit_sizes();
+
   // Some DIEs mark address ranges with high_pc/low_pc pairs (especially
   // functions).
   if (die.has_low_pc() && die.has_high_pc() && die.low_pc() != 0) {
@@ -1549,29 +2627,19 @@ void AddDIE(const dwarf::File& file, const std::string& name,
   // Sometimes a DIE has a linkage_name, which we can look up in the symbol
   // table.
   if (die.has_linkage_name()) {
-    auto it = symtab.find(die.linkage_name());
-    if (it != symtab.end()) {
-      sink->AddVMRangeIgnoreDuplicate("dwarf_linkagename", it->second.first,
-                                      it->second.second, name);
+    const SymbolTable::Entry* entry = symtab.Find(die.linkage_name());
+    if (entry) {
+      sink->AddVMRangeIgnoreDuplicate("dwarf_linkagename", entry->addr,
+                                      entry->size, name);
     }
   }
 
   // Sometimes the DIE has a "location", which gives the location as an address.
-  // This parses a very small subset of the overall DWARF expression grammar.
   if (die.has_location_string()) {
-    string_view location = die.location_string();
-    if (location.size() == sizes.address_size() + 1 &&
-        location[0] == DW_OP_addr) {
-      location.remove_prefix(1);
-      uint64_t addr;
-      // TODO(haberman): endian?
-      if (sizes.address_size() == 4) {
-        addr = dwarf::ReadMemcpy<uint32_t>(&location);
-      } else if (sizes.address_size() == 8) {
-        addr = dwarf::ReadMemcpy<uint64_t>(&location);
-      } else {
-        BLOATY_UNREACHABLE();
-      }
+    absl::optional<uint64_t> location =
+        ReadLocationAddress(die_reader, die.location_string());
+    if (location.has_value()) {
+      uint64_t addr = location.value();
 
       // Unfortunately the location doesn't include a size, so we look that part
       // up in the symbol map.
@@ -1589,10 +2657,13 @@ void AddDIE(const dwarf::File& file, const std::string& name,
     }
   }
 
-  // Sometimes a location is given as an offset into debug_loc.
+  // Sometimes a location is given as an offset into debug_loc (or
+  // debug_loclists, for DWARF 5).
   if (die.has_location_uint64()) {
-    if (die.location_uint64() < file.debug_loc.size()) {
-      absl::string_view loc_range = file.debug_loc.substr(die.location_uint64());
+    string_view debug_loc = sizes.dwarf_version() >= 5 ? file.debug_loclists
+                                                       : file.debug_loc;
+    if (die.location_uint64() < debug_loc.size()) {
+      absl::string_view loc_range = debug_loc.substr(die.location_uint64());
       loc_range = GetLocationListRange(sizes, loc_range);
       sink->AddFileRange("dwarf_locrange", name, loc_range);
     } else if (verbose_level > 0) {
@@ -1606,7 +2677,7 @@ void AddDIE(const dwarf::File& file, const std::string& name,
   uint64_t ranges_offset = UINT64_MAX;
 
   // There are two different attributes that sometimes contain an offset into
-  // debug_ranges.
+  // debug_ranges (or debug_rnglists, for DWARF 5).
   if (die.has_ranges()) {
     ranges_offset = die.ranges();
   } else if (die.has_start_scope()) {
@@ -1614,8 +2685,11 @@ void AddDIE(const dwarf::File& file, const std::string& name,
   }
 
   if (ranges_offset != UINT64_MAX) {
-    if (ranges_offset < file.debug_ranges.size()) {
-      absl::string_view ranges_range = file.debug_ranges.substr(ranges_offset);
+    string_view debug_ranges = sizes.dwarf_version() >= 5
+                                   ? file.debug_rnglists
+                                   : file.debug_ranges;
+    if (ranges_offset < debug_ranges.size()) {
+      absl::string_view ranges_range = debug_ranges.substr(ranges_offset);
       ranges_range = GetRangeListRange(sizes, ranges_range);
       sink->AddFileRange("dwarf_debugrange", name, ranges_range);
     } else if (verbose_level > 0) {
@@ -1900,26 +2974,61 @@ void ReadEhFrameHdr(string_view data, RangeSink* sink) {
 }
 
 static void ReadDWARFStmtListRange(const dwarf::File& file, uint64_t offset,
-                                   string_view unit_name, RangeSink* sink) {
+                                   string_view unit_name,
+                                   dwarf::CompilationUnitSizes unit_sizes,
+                                   RangeSink* sink) {
   string_view data = file.debug_line;
   dwarf::SkipBytes(offset, &data);
   string_view data_with_length = data;
   dwarf::CompilationUnitSizes sizes;
-  data = sizes.ReadInitialLength(&data);
+  string_view unit = sizes.ReadInitialLength(&data);
   data = data_with_length.substr(
-      0, data.size() + (data.data() - data_with_length.data()));
+      0, unit.size() + (unit.data() - data_with_length.data()));
   sink->AddFileRange("dwarf_stmtlistrange", unit_name, data);
+
+  // DWARF 5 line tables keep their directory and file names in
+  // .debug_line_str, so we read the header to attribute those too.
+  sizes.ReadDWARFVersion(&unit);
+  if (sizes.dwarf_version() >= 5) {
+    dwarf::LineInfoReader line_info_reader(file);
+    line_info_reader.set_strp_sink(sink, unit_name);
+    line_info_reader.SeekToOffset(offset, unit_sizes.address_size());
+  }
 }
 
-// The DWARF debug info can help us get compileunits info.  DIEs for compilation
-// units, functions, and global variables often have attributes that will
-// resolve to addresses.
-static void ReadDWARFDebugInfo(
-    const dwarf::File& file, dwarf::DIEReader::Section section,
-    const SymbolTable& symtab, const DualMap& symbol_map, RangeSink* sink,
-    std::unordered_map<uint64_t, std::string>* stmt_list_map) {
-  dwarf::DIEReader die_reader(file);
-  die_reader.set_strp_sink(sink);
+// Attributes a DWARF 5 unit's contribution to one of the tables of indexed
+// values, given the offset of its first entry.  The header is
+// |header_size| bytes long in 32-bit DWARF.
+static void AddDWARF5TableRange(const char* label, string_view section,
+                                absl::optional<uint64_t> base,
+                                size_t header_size,
+                                dwarf::CompilationUnitSizes unit_sizes,
+                                string_view unit_name, RangeSink* sink) {
+  if (!base.has_value()) {
+    return;
+  }
+
+  header_size = dwarf::TableHeaderSize(unit_sizes, header_size);
+  if (base.value() < header_size || base.value() > section.size()) {
+    if (verbose_level > 0) {
+      fprintf(stderr,
+              "bloaty: warning: DWARF table base out of range, base=%" PRIx64
+              "\n",
+              base.value());
+    }
+    return;
+  }
+
+  string_view data = section.substr(base.value() - header_size);
+  string_view data_with_length = data;
+  dwarf::CompilationUnitSizes sizes;
+  string_view table = sizes.ReadInitialLength(&data);
+  data = data_with_length.substr(
+      0, table.size() + (table.data() - data_with_length.data()));
+  sink->AddFileRange(label, unit_name, data);
+}
+
+static dwarf::AttrReader<GeneralDIE> MakeGeneralDIEAttrReader() {
   dwarf::AttrReader<GeneralDIE> attr_reader;
 
   attr_reader.OnAttribute(DW_AT_name,
@@ -1971,15 +3080,111 @@ static void ReadDWARFDebugInfo(
                             die->set_start_scope(uint.value());
                           });
 
-  if (!die_reader.SeekToStart(section)) {
+  // Split DWARF skeletons before DWARF 5 keep these in attributes, rather than
+  // in the unit header and DW_AT_addr_base.
+  attr_reader.OnAttribute(DW_AT_GNU_dwo_id,
+                          [](GeneralDIE* die, dwarf::AttrValue val) {
+                            absl::optional<uint64_t> uint = val.ToUint();
+                            if (!uint.has_value()) return;
+                            die->set_dwo_id(uint.value());
+                          });
+  attr_reader.OnAttribute(DW_AT_GNU_addr_base,
+                          [](GeneralDIE* die, dwarf::AttrValue val) {
+                            absl::optional<uint64_t> uint = val.ToUint();
+                            if (!uint.has_value()) return;
+                            die->set_addr_base(uint.value());
+                          });
+
+  return attr_reader;
+}
+
+// For the DIEs of split units.  Their location and range lists are in the
+// .dwo file, not the binary, so there is nothing to attribute there; only
+// their addresses are worth reading.
+static dwarf::AttrReader<GeneralDIE> MakeSplitDIEAttrReader() {
+  dwarf::AttrReader<GeneralDIE> attr_reader = MakeGeneralDIEAttrReader();
+  attr_reader.OnAttribute(DW_AT_location,
+                          [](GeneralDIE* die, dwarf::AttrValue val) {
+                            if (!val.IsString()) return;
+                            die->set_location_string(val.GetString());
+                          });
+  attr_reader.OnAttribute(DW_AT_ranges, nullptr);
+  attr_reader.OnAttribute(DW_AT_start_scope, nullptr);
+  return attr_reader;
+}
+
+// Returns the name of a split unit, from its first DIE.
+static std::string GetSplitUnitName(const dwarf::SplitUnit& unit) {
+  dwarf::DIEReader die_reader(*unit.sections);
+  dwarf::AttrReader<string_view> attr_reader;
+  attr_reader.OnAttribute(DW_AT_name,
+                          [](string_view* s, dwarf::AttrValue data) {
+                            if (!data.IsString()) return;
+                            *s = data.GetString();
+                          });
+
+  string_view name;
+  if (die_reader.SeekToCompilationUnit(dwarf::DIEReader::Section::kDebugInfo,
+                                       unit.header_offset)) {
+    attr_reader.ReadAttributes(&die_reader, &name);
+  }
+  return std::string(name);
+}
+
+namespace {
+
+// A compilation unit from .debug_info or .debug_types that has been assigned a
+// name, and so will be read by ReadDWARFCompileUnit().
+struct CompileUnitEntry {
+  dwarf::DIEReader::Section section;
+  uint64_t header_offset;
+  std::string name;
+  const dwarf::SplitUnit* split;  // For a skeleton unit, otherwise null.
+};
+
+}  // namespace
+
+// Reads only the first DIE of each compilation unit in |section| to find the
+// unit's name.  A unit with no DW_AT_name borrows the name of an earlier unit
+// that shares its line table, so this pass is sequential and must see
+// .debug_info before .debug_types.  Along the way |die_reader| reads every
+// abbreviation table that the units use.  A skeleton unit is named after its
+// split unit, if |split_units| has it.
+static void FindDWARFCompileUnits(
+    const dwarf::File& file, dwarf::DIEReader::Section section,
+    const dwarf::SplitUnitIndex* split_units, dwarf::DIEReader* die_reader,
+    std::unordered_map<uint64_t, std::string>* stmt_list_map,
+    std::vector<CompileUnitEntry>* units) {
+  dwarf::AttrReader<GeneralDIE> attr_reader = MakeGeneralDIEAttrReader();
+
+  if (!die_reader->SeekToStart(section)) {
     return;
   }
 
+  string_view section_data = section == dwarf::DIEReader::Section::kDebugInfo
+                                 ? file.debug_info
+                                 : file.debug_types;
+
   do {
     GeneralDIE compileunit_die;
-    attr_reader.ReadAttributes(&die_reader, &compileunit_die);
+    attr_reader.ReadAttributes(die_reader, &compileunit_die);
     std::string compileunit_name = std::string(compileunit_die.name());
 
+    const dwarf::SplitUnit* split = nullptr;
+    absl::optional<uint64_t> dwo_id = die_reader->unit_dwo_id();
+    if (compileunit_die.has_dwo_id()) {
+      dwo_id = compileunit_die.dwo_id();
+    }
+    if (split_units && dwo_id.has_value()) {
+      split = split_units->Find(dwo_id.value());
+      if (split) {
+        std::string split_name = GetSplitUnitName(*split);
+        if (!split_name.empty()) {
+          compileunit_name = std::move(split_name);
+        }
+      }
+    }
+
     if (compileunit_die.has_stmt_list()) {
       uint64_t stmt_list = compileunit_die.stmt_list();
       if (compileunit_name.empty()) {
@@ -1996,54 +3201,200 @@ static void ReadDWARFDebugInfo(
       continue;
     }
 
-    die_reader.set_compileunit_name(compileunit_name);
-    sink->AddFileRange("dwarf_debuginfo", compileunit_name,
-                       die_reader.unit_range());
-    AddDIE(file, compileunit_name, compileunit_die, symtab, symbol_map,
-           die_reader.unit_sizes(), sink);
+    uint64_t header_offset =
+        die_reader->unit_range().data() - section_data.data();
+    units->push_back(CompileUnitEntry{section, header_offset,
+                                      std::move(compileunit_name), split});
+  } while (die_reader->NextCompilationUnit());
+}
 
-    if (compileunit_die.has_stmt_list()) {
-      uint64_t offset = compileunit_die.stmt_list();
-      ReadDWARFStmtListRange(file, offset, compileunit_name, sink);
+// Reads the rest of the DIEs of the unit that |die_reader| is in.
+static void AddRemainingDIEs(const dwarf::File& file, const std::string& name,
+                             dwarf::DIEReader* die_reader,
+                             dwarf::AttrReader<GeneralDIE>* attr_reader,
+                             const SymbolTable& symtab,
+                             const DualMap& symbol_map, RangeSink* sink) {
+  while (die_reader->NextDIE()) {
+    GeneralDIE die;
+    attr_reader->ReadAttributes(die_reader, &die);
+
+    // low_pc == 0 is a signal that this routine was stripped out of the
+    // final binary.  Skip this DIE and all of its children.
+    if (die.has_low_pc() && die.low_pc() == 0) {
+      die_reader->SkipChildren();
+    } else {
+      AddDIE(file, name, die, symtab, symbol_map, *die_reader, sink);
     }
+  }
+}
+
+// The DWARF debug info can help us get compileunits info.  DIEs for compilation
+// units, functions, and global variables often have attributes that will
+// resolve to addresses.
+//
+// Reads all the DIEs of a single compilation unit, or just the first one with
+// --dwarf-mode=fast.  This only touches |sink| and its own reader, so
+// different units can be read in parallel.
+// |unit_reader| is the reader that found the unit, whose abbreviation tables
+// we share.
+static void ReadDWARFCompileUnit(const dwarf::File& file,
+                                 const CompileUnitEntry& unit,
+                                 const dwarf::DIEReader& unit_reader,
+                                 const SymbolTable& symtab,
+                                 const DualMap& symbol_map, RangeSink* sink) {
+  dwarf::DIEReader die_reader(file);
+  die_reader.ShareAbbrevTables(unit_reader);
+  dwarf::AttrReader<GeneralDIE> attr_reader = MakeGeneralDIEAttrReader();
+  const std::string& compileunit_name = unit.name;
+  die_reader.set_strp_sink(sink);
+  die_reader.set_compileunit_name(compileunit_name);
 
-    string_view abbrev_data = file.debug_abbrev;
-    dwarf::SkipBytes(die_reader.debug_abbrev_offset(), &abbrev_data);
-    dwarf::AbbrevTable unit_abbrev;
-    abbrev_data = unit_abbrev.ReadAbbrevs(abbrev_data);
-    sink->AddFileRange("dwarf_abbrev", compileunit_name, abbrev_data);
+  if (!die_reader.SeekToCompilationUnit(unit.section, unit.header_offset)) {
+    return;
+  }
 
-    while (die_reader.NextDIE()) {
-      GeneralDIE die;
-      attr_reader.ReadAttributes(&die_reader, &die);
+  GeneralDIE compileunit_die;
+  attr_reader.ReadAttributes(&die_reader, &compileunit_die);
 
-      // low_pc == 0 is a signal that this routine was stripped out of the
-      // final binary.  Skip this DIE and all of its children.
-      if (die.has_low_pc() && die.low_pc() == 0) {
-        die_reader.SkipChildren();
-      } else {
-        AddDIE(file, compileunit_name, die, symtab, symbol_map,
-               die_reader.unit_sizes(), sink);
-      }
+  sink->AddFileRange("dwarf_debuginfo", compileunit_name,
+                     die_reader.unit_range());
+  AddDIE(file, compileunit_name, compileunit_die, symtab, symbol_map,
+         die_reader, sink);
+
+  if (compileunit_die.has_stmt_list()) {
+    uint64_t offset = compileunit_die.stmt_list();
+    ReadDWARFStmtListRange(file, offset, compileunit_name,
+                           die_reader.unit_sizes(), sink);
+  }
+
+  sink->AddFileRange("dwarf_abbrev", compileunit_name,
+                     die_reader.unit_abbrev().data());
+
+  const dwarf::DIEReader::UnitBases& bases = die_reader.unit_bases();
+  dwarf::CompilationUnitSizes sizes = die_reader.unit_sizes();
+  AddDWARF5TableRange("dwarf_stroffsets", file.debug_str_offsets,
+                      bases.str_offsets, dwarf::kStrOffsetsHeaderSize, sizes,
+                      compileunit_name, sink);
+  AddDWARF5TableRange("dwarf_addr", file.debug_addr, bases.addr,
+                      dwarf::kAddrHeaderSize, sizes, compileunit_name, sink);
+  AddDWARF5TableRange("dwarf_rnglists", file.debug_rnglists, bases.rnglists,
+                      dwarf::kListsHeaderSize, sizes, compileunit_name, sink);
+  AddDWARF5TableRange("dwarf_loclists", file.debug_loclists, bases.loclists,
+                      dwarf::kListsHeaderSize, sizes, compileunit_name, sink);
+
+  if (sink->options().dwarf_mode() == Options::DWARF_MODE_FAST) {
+    return;
+  }
+
+  AddRemainingDIEs(file, compileunit_name, &die_reader, &attr_reader, symtab,
+                   symbol_map, sink);
+
+  if (!unit.split) {
+    return;
+  }
+
+  // The rest of a skeleton's unit is in the .dwo file, which we don't count,
+  // but its DIEs still find code and data in the binary for us.
+  absl::optional<uint64_t> addr_base = bases.addr;
+  if (compileunit_die.has_addr_base()) {
+    addr_base = compileunit_die.addr_base();
+  }
+
+  std::unique_ptr<dwarf::File> split_sections =
+      dwarf::SplitSections(*unit.split->sections, file.debug_addr);
+  dwarf::DIEReader split_reader(*split_sections);
+  split_reader.set_skeleton_addr_base(addr_base);
+  dwarf::AttrReader<GeneralDIE> split_attr_reader = MakeSplitDIEAttrReader();
+  if (!split_reader.SeekToCompilationUnit(
+          dwarf::DIEReader::Section::kDebugInfo, unit.split->header_offset)) {
+    return;
+  }
+
+  GeneralDIE split_die;
+  split_attr_reader.ReadAttributes(&split_reader, &split_die);
+  // The split DIEs' offsets into location and range lists refer to the .dwo
+  // file's lists, so they must not be looked up in the binary's.  Ranges in
+  // the .dwo file aren't part of the binary, and the sink drops them.
+  AddDIE(*split_sections, compileunit_name, split_die, symtab, symbol_map,
+         split_reader, sink);
+  AddRemainingDIEs(*split_sections, compileunit_name, &split_reader,
+                   &split_attr_reader, symtab, symbol_map, sink);
+}
+
+// Calls |read_unit| for each of |count| units, in parallel if |parallel| is
+// set and there is more than one.  Each unit's ranges are recorded and then
+// replayed into |sink| in unit order, so the first unit to claim a range still
+// wins.  As with archive members, we go a window at a time to bound the
+// recorded ranges we hold.
+static void ReadDWARFUnits(
+    size_t count, bool parallel, RangeSink* sink,
+    const std::function<void(size_t, RangeSink*)>& read_unit) {
+  if (!parallel || count <= 1 || std::thread::hardware_concurrency() <= 1) {
+    for (size_t i = 0; i < count; i++) {
+      read_unit(i, sink);
     }
-  } while (die_reader.NextCompilationUnit());
+    return;
+  }
+
+  constexpr size_t kWindowSize = 256;
+  for (size_t start = 0; start < count; start += kWindowSize) {
+    size_t window = std::min(kWindowSize, count - start);
+    std::vector<std::unique_ptr<RangeSink>> recorders(window);
+
+    ParallelForEach(window, [&](size_t i) {
+      recorders[i] = RangeSink::CreateRecorder(*sink);
+      read_unit(start + i, recorders[i].get());
+    });
+
+    for (const auto& recorder : recorders) {
+      recorder->Replay(sink);
+    }
+  }
 }
 
-void ReadDWARFCompileUnits(const dwarf::File& file, const SymbolTable& symtab,
+void IndexSplitDWARF(dwarf::SplitFiles* files) {
+  files->index.reset(new dwarf::SplitUnitIndex(*files));
+}
+
+void ReadDWARFCompileUnits(const dwarf::File& file,
+                           const dwarf::SplitFiles* split,
+                           const SymbolTable& symtab,
                            const DualMap& symbol_map, RangeSink* sink) {
   if (!file.debug_info.size()) {
     THROW("missing debug info");
   }
 
+  const dwarf::SplitUnitIndex* split_units =
+      split ? split->index.get() : nullptr;
+
+  std::unordered_map<uint64_t, std::string> stmt_list_map;
+  std::vector<CompileUnitEntry> units;
+  dwarf::DIEReader unit_reader(file);
+  FindDWARFCompileUnits(file, dwarf::DIEReader::Section::kDebugInfo,
+                        split_units, &unit_reader, &stmt_list_map,
+                        &units);
+  FindDWARFCompileUnits(file, dwarf::DIEReader::Section::kDebugTypes,
+                        split_units, &unit_reader, &stmt_list_map,
+                        &units);
+
   if (file.debug_aranges.size()) {
-    ReadDWARFAddressRanges(file, sink);
+    std::unordered_map<uint64_t, std::string> skeleton_names;
+    for (const CompileUnitEntry& unit : units) {
+      if (unit.split) {
+        skeleton_names[unit.header_offset] = unit.name;
+      }
+    }
+    ReadDWARFAddressRanges(file, std::move(skeleton_names), sink);
   }
 
-  std::unordered_map<uint64_t, std::string> stmt_list_map;
-  ReadDWARFDebugInfo(file, dwarf::DIEReader::Section::kDebugInfo, symtab,
-                     symbol_map, sink, &stmt_list_map);
-  ReadDWARFDebugInfo(file, dwarf::DIEReader::Section::kDebugTypes, symtab,
-                     symbol_map, sink, &stmt_list_map);
+  // In fast mode there is too little work per unit to be worth a thread.
+  bool parallel = sink->options().dwarf_mode() != Options::DWARF_MODE_FAST;
+  ReadDWARFUnits(units.size(), parallel, sink,
+                 [&](size_t i, RangeSink* unit_sink) {
+                   ReadDWARFCompileUnit(file, units[i], unit_reader, symtab,
+                                        symbol_map, unit_sink);
+                 });
+
   ReadDWARFPubNames(file, file.debug_pubnames, sink);
   ReadDWARFPubNames(file, file.debug_pubtypes, sink);
 }
@@ -2057,34 +3408,46 @@ static std::string LineInfoKey(const std::string& file, uint32_t line,
   }
 }
 
+// Adds a range for each span of rows with the same file (and line, if
+// |include_line|).  Rows are compared by filename ID and line number, and the
+// label is only built for the spans we add.
 static void ReadDWARFStmtList(bool include_line,
                               dwarf::LineInfoReader* line_info_reader,
                               RangeSink* sink) {
   uint64_t span_startaddr = 0;
-  std::string last_source;
+  bool has_last = false;
+  uint32_t last_file = 0;
+  std::pair<uint32_t, uint32_t> last_key;  // Filename ID and line.
 
   while (line_info_reader->ReadLineInfo()) {
     const auto& line_info = line_info_reader->lineinfo();
     auto addr = line_info.address;
-    auto number = line_info.line;
-    auto name =
-        line_info.end_sequence
-            ? last_source
-            : LineInfoKey(line_info_reader->GetExpandedFilename(line_info.file),
-                          number, include_line);
+    auto key = last_key;
+    if (!line_info.end_sequence) {
+      key = std::make_pair(line_info_reader->GetFilenameId(line_info.file),
+                           include_line ? line_info.line : 0);
+    }
     if (!span_startaddr) {
       span_startaddr = addr;
-    } else if (line_info.end_sequence ||
-               (!last_source.empty() && name != last_source)) {
+    } else if (line_info.end_sequence || (has_last && key != last_key)) {
+      std::string name;
+      if (has_last) {
+        name = LineInfoKey(line_info_reader->GetExpandedFilename(last_file),
+                           last_key.second, include_line);
+      }
       sink->AddVMRange("dwarf_stmtlist", span_startaddr, addr - span_startaddr,
-                       last_source);
+                       name);
       if (line_info.end_sequence) {
         span_startaddr = 0;
       } else {
         span_startaddr = addr;
       }
     }
-    last_source = name;
+    if (!line_info.end_sequence) {
+      has_last = true;
+      last_file = line_info.file;
+    }
+    last_key = key;
   }
 }
 
@@ -2095,7 +3458,6 @@ void ReadDWARFInlines(const dwarf::File& file, RangeSink* sink,
   }
 
   dwarf::DIEReader die_reader(file);
-  dwarf::LineInfoReader line_info_reader(file);
   dwarf::AttrReader<InlinesDIE> attr_reader;
 
   attr_reader.OnAttribute(
@@ -2109,21 +3471,42 @@ void ReadDWARFInlines(const dwarf::File& file, RangeSink* sink,
     THROW("debug info is present, but empty");
   }
 
-  while (true) {
+  // Find each unit's line table, then run the line programs in parallel.
+  std::vector<std::pair<uint64_t, uint8_t>> stmt_lists;  // Offset, addr size.
+  do {
     InlinesDIE die;
     attr_reader.ReadAttributes(&die_reader, &die);
 
     if (die.has_stmt_list()) {
-      uint64_t offset = die.stmt_list();
-      line_info_reader.SeekToOffset(offset,
-                                    die_reader.unit_sizes().address_size());
-      ReadDWARFStmtList(include_line, &line_info_reader, sink);
+      stmt_lists.emplace_back(die.stmt_list(),
+                              die_reader.unit_sizes().address_size());
     }
+  } while (die_reader.NextCompilationUnit());
 
-    if (!die_reader.NextCompilationUnit()) {
-      return;
-    }
+  ReadDWARFUnits(stmt_lists.size(), true, sink,
+                 [&](size_t i, RangeSink* unit_sink) {
+                   dwarf::LineInfoReader line_info_reader(file);
+                   line_info_reader.SeekToOffset(stmt_lists[i].first,
+                                                 stmt_lists[i].second);
+                   ReadDWARFStmtList(include_line, &line_info_reader,
+                                     unit_sink);
+                 });
+}
+
+void PrintDWARFStats() {
+  uint64_t skipped = dwarf::skipped_die_bytes;
+  if (skipped == 0) {
+    return;
   }
+  uint64_t sibling_skipped = dwarf::sibling_skipped_die_bytes;
+  printf("DWARF: skipped %" PRIu64 " bytes of DIEs, %" PRIu64
+         " (%.1f%%) via DW_AT_sibling\n",
+         skipped, sibling_skipped, 100.0 * sibling_skipped / skipped);
+}
+
+void ResetDWARFStats() {
+  dwarf::skipped_die_bytes = 0;
+  dwarf::sibling_skipped_die_bytes = 0;
 }
 
 }  // namespace bloaty
@@ -87,6 +87,15 @@ enum DwarfTag {
   DW_TAG_type_unit = 0x41,
   DW_TAG_rvalue_reference_type = 0x42,
   DW_TAG_template_alias = 0x43,
+  // DWARF 5.
+  DW_TAG_coarray_type = 0x44,
+  DW_TAG_generic_subrange = 0x45,
+  DW_TAG_dynamic_type = 0x46,
+  DW_TAG_atomic_type = 0x47,
+  DW_TAG_call_site = 0x48,
+  DW_TAG_call_site_parameter = 0x49,
+  DW_TAG_skeleton_unit = 0x4a,
+  DW_TAG_immutable_type = 0x4b,
   DW_TAG_lo_user = 0x4080,
   DW_TAG_hi_user = 0xffff,
   // SGI/MIPS Extensions.
@@ -152,9 +161,27 @@ enum DwarfForm {
   DW_FORM_exprloc = 0x18,
   DW_FORM_flag_present = 0x19,
   // DWARF 5.
+  DW_FORM_strx = 0x1a,
+  DW_FORM_addrx = 0x1b,
+  DW_FORM_ref_sup4 = 0x1c,
+  DW_FORM_strp_sup = 0x1d,
+  DW_FORM_data16 = 0x1e,
   DW_FORM_line_strp = 0x1f,
   // DWARF 4.
   DW_FORM_ref_sig8 = 0x20,
+  // DWARF 5.
+  DW_FORM_implicit_const = 0x21,
+  DW_FORM_loclistx = 0x22,
+  DW_FORM_rnglistx = 0x23,
+  DW_FORM_ref_sup8 = 0x24,
+  DW_FORM_strx1 = 0x25,
+  DW_FORM_strx2 = 0x26,
+  DW_FORM_strx3 = 0x27,
+  DW_FORM_strx4 = 0x28,
+  DW_FORM_addrx1 = 0x29,
+  DW_FORM_addrx2 = 0x2a,
+  DW_FORM_addrx3 = 0x2b,
+  DW_FORM_addrx4 = 0x2c,
   // Extensions for Fission.  See http://gcc.gnu.org/wiki/DebugFission.
   DW_FORM_GNU_addr_index = 0x1f01,
   DW_FORM_GNU_str_index = 0x1f02
@@ -261,6 +288,36 @@ enum DwarfAttribute {
   DW_AT_const_expr = 0x6c,
   DW_AT_enum_class = 0x6d,
   DW_AT_linkage_name = 0x6e,
+  // DWARF 5.
+  DW_AT_string_length_bit_size = 0x6f,
+  DW_AT_string_length_byte_size = 0x70,
+  DW_AT_rank = 0x71,
+  DW_AT_str_offsets_base = 0x72,
+  DW_AT_addr_base = 0x73,
+  DW_AT_rnglists_base = 0x74,
+  DW_AT_dwo_name = 0x76,
+  DW_AT_reference = 0x77,
+  DW_AT_rvalue_reference = 0x78,
+  DW_AT_macros = 0x79,
+  DW_AT_call_all_calls = 0x7a,
+  DW_AT_call_all_source_calls = 0x7b,
+  DW_AT_call_all_tail_calls = 0x7c,
+  DW_AT_call_return_pc = 0x7d,
+  DW_AT_call_value = 0x7e,
+  DW_AT_call_origin = 0x7f,
+  DW_AT_call_parameter = 0x80,
+  DW_AT_call_pc = 0x81,
+  DW_AT_call_tail_call = 0x82,
+  DW_AT_call_target = 0x83,
+  DW_AT_call_target_clobbered = 0x84,
+  DW_AT_call_data_location = 0x85,
+  DW_AT_call_data_value = 0x86,
+  DW_AT_noreturn = 0x87,
+  DW_AT_alignment = 0x88,
+  DW_AT_export_symbols = 0x89,
+  DW_AT_deleted = 0x8a,
+  DW_AT_defaulted = 0x8b,
+  DW_AT_loclists_base = 0x8c,
   // SGI/MIPS extensions.
   DW_AT_MIPS_fde = 0x2001,
   DW_AT_MIPS_loop_begin = 0x2002,
@@ -410,6 +467,41 @@ enum DwarfLineNumberContentType {
   DW_LNCT_decl_line = 8
 };
 
+// Unit header unit type encodings (DWARF 5).
+enum DwarfUnitType {
+  DW_UT_compile = 0x01,
+  DW_UT_type = 0x02,
+  DW_UT_partial = 0x03,
+  DW_UT_skeleton = 0x04,
+  DW_UT_split_compile = 0x05,
+  DW_UT_split_type = 0x06
+};
+
+// Range list entry kinds (DWARF 5).
+enum DwarfRangeListEntry {
+  DW_RLE_end_of_list = 0x00,
+  DW_RLE_base_addressx = 0x01,
+  DW_RLE_startx_endx = 0x02,
+  DW_RLE_startx_length = 0x03,
+  DW_RLE_offset_pair = 0x04,
+  DW_RLE_base_address = 0x05,
+  DW_RLE_start_end = 0x06,
+  DW_RLE_start_length = 0x07
+};
+
+// Location list entry kinds (DWARF 5).
+enum DwarfLocationListEntry {
+  DW_LLE_end_of_list = 0x00,
+  DW_LLE_base_addressx = 0x01,
+  DW_LLE_startx_endx = 0x02,
+  DW_LLE_startx_length = 0x03,
+  DW_LLE_offset_pair = 0x04,
+  DW_LLE_default_location = 0x05,
+  DW_LLE_base_address = 0x06,
+  DW_LLE_start_end = 0x07,
+  DW_LLE_start_length = 0x08
+};
+
 // Type encoding names and codes
 enum DwarfEncoding {
   DW_ATE_address                     =0x1,
@@ -592,6 +684,17 @@ enum DwarfOpcode {
   // DWARF4
   DW_OP_implicit_value               =0x9e,
   DW_OP_stack_value                  =0x9f,
+  // DWARF5
+  DW_OP_implicit_pointer             =0xa0,
+  DW_OP_addrx                        =0xa1,
+  DW_OP_constx                       =0xa2,
+  DW_OP_entry_value                  =0xa3,
+  DW_OP_const_type                   =0xa4,
+  DW_OP_regval_type                  =0xa5,
+  DW_OP_deref_type                   =0xa6,
+  DW_OP_xderef_type                  =0xa7,
+  DW_OP_convert                      =0xa8,
+  DW_OP_reinterpret                  =0xa9,
   DW_OP_lo_user                      =0xe0,
   DW_OP_hi_user                      =0xff,
   // GNU extensions
@@ -616,7 +719,11 @@ enum DwarfSectionId {
   DW_SECT_LOC = 5,
   DW_SECT_STR_OFFSETS = 6,
   DW_SECT_MACINFO = 7,
-  DW_SECT_MACRO = 8
+  DW_SECT_MACRO = 8,
+  // DWARF 5 packages (index version 5) have no DW_SECT_TYPES and reuse
+  // some of the numbers above.
+  DW_SECT_LOCLISTS = 5,
+  DW_SECT_RNGLISTS = 8
 };
 
 // For .eh_frame, see: http://refspecs.linuxfoundation.org/LSB_5.0.0/LSB-Core-generic/LSB-Core-generic/dwarfext.html
@@ -16,10 +16,13 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <new>
 #include <sstream>
+#include <thread>
 #include "absl/numeric/int128.h"
 #include "absl/strings/escaping.h"
 #include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
 #include "absl/strings/substitute.h"
 #include "re2/re2.h"
 #include "third_party/freebsd_elf/elf.h"
@@ -27,11 +30,37 @@
 #include "link_map.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <limits.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef BLOATY_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef BLOATY_HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 // Not present in the FreeBSD ELF headers.
 #define NT_GNU_BUILD_ID 3
+#define ELFCOMPRESS_ZLIB 1
+#define ELFCOMPRESS_ZSTD 2
+
+typedef struct {
+  Elf32_Word ch_type;
+  Elf32_Word ch_size;
+  Elf32_Word ch_addralign;
+} Elf32_Chdr;
+
+typedef struct {
+  Elf64_Word ch_type;
+  Elf64_Word ch_reserved;
+  Elf64_Xword ch_size;
+  Elf64_Xword ch_addralign;
+} Elf64_Chdr;
 
 using absl::string_view;
 
@@ -177,6 +206,20 @@ class ElfFile {
     void ReadSymbol(Elf64_Word index, Elf64_Sym* sym,
                     string_view* file_range) const;
 
+    // Requires: header().sh_type == SHT_SYMTAB || header().sh_type ==
+    // SHT_DYNSYM
+    //
+    // Reads every symbol after the initial null symbol and appends the ones
+    // that |keep| returns true for to |syms|.  Native 64-bit tables are
+    // scanned in place, so only the symbols we keep are copied.
+    template <class Pred>
+    void ReadSymbols(Pred keep, std::vector<Elf64_Sym>* syms) const;
+
+    // Requires: header().sh_flags & SHF_COMPRESSED
+    //
+    // Reads the compression header and returns the compressed data after it.
+    void ReadCompressionHeader(Elf64_Chdr* chdr, string_view* data) const;
+
     // Requires: header().sh_type == SHT_REL
     void ReadRelocation(Elf64_Word index, Elf64_Rel* rel,
                         string_view* file_range) const;
@@ -198,11 +241,15 @@ class ElfFile {
   class NoteIter {
    public:
     NoteIter(const Section& section)
-        : elf_(&section.elf()), remaining_(section.contents()) {
-      Next();
-    }
+        : NoteIter(section.contents(), section.elf().is_64bit(),
+                   section.elf().is_native_endian()) {}
     NoteIter(const Segment& segment, const ElfFile* elf)
-        : elf_(elf), remaining_(segment.contents()) {
+        : NoteIter(segment.contents(), elf->is_64bit(),
+                   elf->is_native_endian()) {}
+    NoteIter(string_view notes, bool is_64bit, bool is_native_endian)
+        : is_64bit_(is_64bit),
+          is_native_endian_(is_native_endian),
+          remaining_(notes) {
       Next();
     }
 
@@ -214,7 +261,8 @@ class ElfFile {
     void Next();
 
    public:
-    const ElfFile* elf_;
+    bool is_64bit_;
+    bool is_native_endian_;
     string_view name_;
     string_view descriptor_;
     string_view remaining_;
@@ -225,15 +273,34 @@ class ElfFile {
   void ReadSegment(Elf64_Word index, Segment* segment) const;
   void ReadSection(Elf64_Word index, Section* section) const;
 
+  // Like ReadSection(), but only the header, which was already checked.
+  const Elf64_Shdr& section_header(Elf64_Word index) const {
+    assert(index < section_count_);
+    return sections_[index].header();
+  }
+
   bool FindSectionByName(absl::string_view name, Section* section) const;
 
   bool is_64bit() const { return is_64bit_; }
   bool is_native_endian() const { return is_native_endian_; }
 
+  // Finds the GNU build ID of the ELF file open at |fd| by reading only its
+  // headers and notes, rather than mapping the whole file.  Returns false if
+  // the file isn't ELF.  Leaves |build_id| empty if the file has no build ID.
+  static bool ProbeBuildId(int fd, uint64_t file_size, std::string* build_id);
+
  private:
   friend class Section;
 
+  // Reads the class and byte order from the ELF identification bytes.
+  // Returns false if |data| doesn't start with the ELF magic number.
+  static bool ReadIdent(string_view data, bool* is_64bit,
+                        bool* is_native_endian);
+
+  BLOATY_DISALLOW_COPY_AND_ASSIGN(ElfFile);
+
   bool Initialize();
+  void DecodeSection(Elf64_Word index, Section* section) const;
 
   string_view GetRegion(uint64_t start, uint64_t n) const {
     return StrictSubstr(data_, start, n);
@@ -244,12 +311,15 @@ class ElfFile {
   class StructReader {
    public:
     StructReader(const ElfFile& elf, string_view data)
-        : elf_(elf), data_(data) {}
+        : StructReader(elf.is_64bit(), elf.is_native_endian(), data) {}
+    StructReader(bool is_64bit, bool is_native_endian, string_view data)
+        : is_64bit_(is_64bit), is_native_endian_(is_native_endian),
+          data_(data) {}
 
     template <class T32, class T64, class Munger>
     void Read(uint64_t offset, Munger /*munger*/, absl::string_view* range,
               T64* out) const {
-      if (elf_.is_64bit() && elf_.is_native_endian()) {
+      if (is_64bit_ && is_native_endian_) {
         return Memcpy(offset, range, out);
       } else {
         return ReadFallback<T32, T64, Munger>(offset, range, out);
@@ -257,7 +327,8 @@ class ElfFile {
     }
 
    private:
-    const ElfFile& elf_;
+    bool is_64bit_;
+    bool is_native_endian_;
     string_view data_;
 
     template <class T32, class T64, class Munger>
@@ -294,6 +365,15 @@ class ElfFile {
   string_view section_headers_;
   string_view segment_headers_;
   Section section_name_table_;
+
+  // Section and segment headers, decoded once up front so that readers don't
+  // have to convert them again every time they are read.
+  std::vector<Section> sections_;
+  std::vector<Segment> segments_;
+
+  // Built on the first call to FindSectionByName().
+  mutable std::once_flag section_index_once_;
+  mutable std::unordered_map<string_view, Elf64_Word> section_index_;
 };
 
 // ELF uses different structure definitions for 32/64 bit files.  The sizes of
@@ -386,6 +466,15 @@ struct RelaMunger {
   }
 };
 
+struct ChdrMunger {
+  template <class From, class Func>
+  void operator()(const From& from, Elf64_Chdr* to, Func func) {
+    to->ch_type      = func(from.ch_type);
+    to->ch_size      = func(from.ch_size);
+    to->ch_addralign = func(from.ch_addralign);
+  }
+};
+
 struct NoteMunger {
   template <class From, class Func>
   void operator()(const From& from, Elf64_Nhdr* to, Func func) {
@@ -399,14 +488,14 @@ template <class T32, class T64, class Munger>
 void ElfFile::StructReader::ReadFallback(uint64_t offset,
                                          absl::string_view* range,
                                          T64* out) const {
-  if (elf_.is_64bit()) {
-    assert(!elf_.is_native_endian());
+  if (is_64bit_) {
+    assert(!is_native_endian_);
     Memcpy(offset, range, out);
     Munger()(*out, out, ByteSwapFunc());
   } else {
     T32 data32;
     Memcpy(offset, range, &data32);
-    if (elf_.is_native_endian()) {
+    if (is_native_endian_) {
       Munger()(data32, out, NullFunc());
     } else {
       Munger()(data32, out, ByteSwapFunc());
@@ -457,6 +546,43 @@ void ElfFile::Section::ReadSymbol(Elf64_Word index, Elf64_Sym* sym,
   elf_->ReadStruct<Elf32_Sym>(contents(), offset, SymMunger(), file_range, sym);
 }
 
+template <class Pred>
+void ElfFile::Section::ReadSymbols(Pred keep,
+                                   std::vector<Elf64_Sym>* syms) const {
+  assert(header().sh_type == SHT_SYMTAB || header().sh_type == SHT_DYNSYM);
+  Elf64_Word count = GetEntryCount();
+  const char* data = contents_.data();
+
+  if (elf_->is_64bit() && elf_->is_native_endian() &&
+      header_.sh_entsize == sizeof(Elf64_Sym) &&
+      reinterpret_cast<uintptr_t>(data) % alignof(Elf64_Sym) == 0) {
+    // GetEntryCount() guarantees that all |count| entries are in bounds.
+    const Elf64_Sym* table = reinterpret_cast<const Elf64_Sym*>(data);
+    for (Elf64_Word i = 1; i < count; i++) {
+      if (keep(table[i])) {
+        syms->push_back(table[i]);
+      }
+    }
+    return;
+  }
+
+  for (Elf64_Word i = 1; i < count; i++) {
+    Elf64_Sym sym;
+    ReadSymbol(i, &sym, nullptr);
+    if (keep(sym)) {
+      syms->push_back(sym);
+    }
+  }
+}
+
+void ElfFile::Section::ReadCompressionHeader(Elf64_Chdr* chdr,
+                                             string_view* data) const {
+  assert(header().sh_flags & SHF_COMPRESSED);
+  string_view range;
+  elf_->ReadStruct<Elf32_Chdr>(contents(), 0, ChdrMunger(), &range, chdr);
+  *data = contents().substr(range.size());
+}
+
 void ElfFile::Section::ReadRelocation(Elf64_Word index, Elf64_Rel* rel,
                                       string_view* file_range) const {
   assert(header().sh_type == SHT_REL);
@@ -480,7 +606,8 @@ void ElfFile::NoteIter::Next() {
   }
 
   Elf_Note note;
-  elf_->ReadStruct<Elf_Note>(remaining_, 0, NoteMunger(), nullptr, &note);
+  StructReader(is_64bit_, is_native_endian_, remaining_)
+      .Read<Elf_Note>(0, NoteMunger(), nullptr, &note);
 
   // 32-bit and 64-bit note are the same size, so we don't have to treat
   // them separately when advancing.
@@ -499,13 +626,14 @@ void ElfFile::NoteIter::Next() {
   remaining_ = StrictSubstr(remaining_, AlignUp(note.n_descsz, 4));
 }
 
-bool ElfFile::Initialize() {
-  if (data_.size() < EI_NIDENT) {
+bool ElfFile::ReadIdent(string_view data, bool* is_64bit,
+                        bool* is_native_endian) {
+  if (data.size() < EI_NIDENT) {
     return false;
   }
 
   unsigned char ident[EI_NIDENT];
-  memcpy(ident, data_.data(), EI_NIDENT);
+  memcpy(ident, data.data(), EI_NIDENT);
 
   if (memcmp(ident, "\177ELF", 4) != 0) {
     // Not an ELF file.
@@ -514,10 +642,10 @@ bool ElfFile::Initialize() {
 
   switch (ident[EI_CLASS]) {
     case ELFCLASS32:
-      is_64bit_ = false;
+      *is_64bit = false;
       break;
     case ELFCLASS64:
-      is_64bit_ = true;
+      *is_64bit = true;
       break;
     default:
       THROWF("unexpected ELF class: $0", ident[EI_CLASS]);
@@ -525,15 +653,23 @@ bool ElfFile::Initialize() {
 
   switch (ident[EI_DATA]) {
     case ELFDATA2LSB:
-      is_native_endian_ = IsLittleEndian();
+      *is_native_endian = IsLittleEndian();
       break;
     case ELFDATA2MSB:
-      is_native_endian_ = !IsLittleEndian();
+      *is_native_endian = !IsLittleEndian();
       break;
     default:
       THROWF("unexpected ELF data: $0", ident[EI_DATA]);
   }
 
+  return true;
+}
+
+bool ElfFile::Initialize() {
+  if (!ReadIdent(data_, &is_64bit_, &is_native_endian_)) {
+    return false;
+  }
+
   absl::string_view range;
   ReadStruct<Elf32_Ehdr>(entire_file(), 0, EhdrMunger(), &range, &header_);
 
@@ -545,8 +681,7 @@ bool ElfFile::Initialize() {
   // https://docs.oracle.com/cd/E19683-01/817-3677/chapter6-94076/index.html
   if (header_.e_shoff > 0 &&
       data_.size() > (header_.e_shoff + header_.e_shentsize)) {
-    section_count_ = 1;
-    ReadSection(0, &section0);
+    DecodeSection(0, &section0);
     has_section0 = true;
   }
 
@@ -567,6 +702,25 @@ bool ElfFile::Initialize() {
   segment_headers_ = GetRegion(
       header_.e_phoff, CheckedMul(header_.e_phentsize, header_.e_phnum));
 
+  size_t shdr_size = is_64bit_ ? sizeof(Elf64_Shdr) : sizeof(Elf32_Shdr);
+  if (section_count_ > 0 && header_.e_shentsize < shdr_size) {
+    THROWF("ELF section header entry size too small: $0", header_.e_shentsize);
+  }
+
+  sections_.resize(section_count_);
+  for (Elf64_Xword i = 0; i < section_count_; i++) {
+    DecodeSection(i, &sections_[i]);
+  }
+
+  segments_.resize(header_.e_phnum);
+  for (Elf64_Xword i = 0; i < header_.e_phnum; i++) {
+    Segment* segment = &segments_[i];
+    ReadStruct<Elf32_Phdr>(
+        entire_file(),
+        CheckedAdd(header_.e_phoff, CheckedMul(header_.e_phentsize, i)),
+        PhdrMunger(), &segment->range_, &segment->header_);
+  }
+
   if (section_count_ > 0) {
     ReadSection(section_string_index_, &section_name_table_);
     if (section_name_table_.header().sh_type != SHT_STRTAB) {
@@ -577,18 +731,24 @@ bool ElfFile::Initialize() {
   return true;
 }
 
+// Decodes only the header; the contents are checked when the section is read.
+void ElfFile::DecodeSection(Elf64_Word index, Section* section) const {
+  ReadStruct<Elf32_Shdr>(
+      entire_file(),
+      CheckedAdd(header_.e_shoff, CheckedMul(header_.e_shentsize, index)),
+      ShdrMunger(), &section->range_, &section->header_);
+  section->elf_ = this;
+}
+
 void ElfFile::ReadSegment(Elf64_Word index, Segment* segment) const {
   if (index >= header_.e_phnum) {
     THROWF("segment $0 doesn't exist, only $1 segments", index,
            header_.e_phnum);
   }
 
-  Elf64_Phdr* header = &segment->header_;
-  ReadStruct<Elf32_Phdr>(
-      entire_file(),
-      CheckedAdd(header_.e_phoff, CheckedMul(header_.e_phentsize, index)),
-      PhdrMunger(), &segment->range_, header);
-  segment->contents_ = GetRegion(header->p_offset, header->p_filesz);
+  *segment = segments_[index];
+  const Elf64_Phdr& header = segment->header_;
+  segment->contents_ = GetRegion(header.p_offset, header.p_filesz);
 }
 
 void ElfFile::ReadSection(Elf64_Word index, Section* section) const {
@@ -597,29 +757,132 @@ void ElfFile::ReadSection(Elf64_Word index, Section* section) const {
            section_count_);
   }
 
-  Elf64_Shdr* header = &section->header_;
-  ReadStruct<Elf32_Shdr>(
-      entire_file(),
-      CheckedAdd(header_.e_shoff, CheckedMul(header_.e_shentsize, index)),
-      ShdrMunger(), &section->range_, header);
-
-  if (header->sh_type == SHT_NOBITS) {
+  *section = sections_[index];
+  const Elf64_Shdr& header = section->header_;
+  if (header.sh_type == SHT_NOBITS) {
     section->contents_ = string_view();
   } else {
-    section->contents_ = GetRegion(header->sh_offset, header->sh_size);
+    section->contents_ = GetRegion(header.sh_offset, header.sh_size);
   }
-
-  section->elf_ = this;
 }
 
 bool ElfFile::FindSectionByName(absl::string_view name, Section* section) const {
-  for (Elf64_Word i = 0; i < section_count_; i++) {
-    ReadSection(i, section);
-    if (section->GetName() == name) {
-      return true;
+  std::call_once(section_index_once_, [this]() {
+    for (Elf64_Word i = 0; i < section_count_; i++) {
+      // The first section with a given name wins.
+      section_index_.emplace(sections_[i].GetName(), i);
+    }
+  });
+  auto it = section_index_.find(name);
+  if (it == section_index_.end()) {
+    return false;
+  }
+  ReadSection(it->second, section);
+  return true;
+}
+
+
+// Reads |size| bytes at |offset| in |fd|.
+static std::string PreadRegion(int fd, uint64_t file_size, uint64_t offset,
+                               uint64_t size) {
+  if (CheckedAdd(offset, size) > file_size) {
+    THROW("ELF region out-of-bounds");
+  }
+  std::string ret(size, '\0');
+  uint64_t done = 0;
+  while (done < size) {
+    ssize_t n = pread(fd, &ret[done], size - done, offset + done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0) {
+      THROWF("error reading ELF headers: $0", strerror(errno));
+    } else if (n == 0) {
+      THROW("premature EOF reading ELF headers");
+    }
+    done += n;
+  }
+  return ret;
+}
+
+bool ElfFile::ProbeBuildId(int fd, uint64_t file_size,
+                           std::string* build_id) {
+  build_id->clear();
+  std::string data = PreadRegion(
+      fd, file_size, 0, std::min<uint64_t>(file_size, sizeof(Elf64_Ehdr)));
+  bool is_64bit;
+  bool is_native_endian;
+  if (!ReadIdent(data, &is_64bit, &is_native_endian)) {
+    return false;
+  }
+
+  Elf64_Ehdr header;
+  StructReader(is_64bit, is_native_endian, data)
+      .Read<Elf32_Ehdr>(0, EhdrMunger(), nullptr, &header);
+
+  if (header.e_type == ET_REL) {
+    // Object files don't have a build ID.
+    return true;
+  }
+
+  auto find_build_id = [&](uint64_t offset, uint64_t size) {
+    std::string notes = PreadRegion(fd, file_size, offset, size);
+    for (NoteIter iter(notes, is_64bit, is_native_endian); !iter.IsDone();
+         iter.Next()) {
+      if (iter.name() == "GNU" && iter.type() == NT_GNU_BUILD_ID) {
+        *build_id = std::string(iter.descriptor());
+        return true;
+      }
+    }
+    return false;
+  };
+
+  // Like ElfObjectFile::GetBuildId(), search the sections before the
+  // segments.
+  if (header.e_shoff > 0) {
+    Elf64_Xword count = header.e_shnum;
+    size_t shdr_size = is_64bit ? sizeof(Elf64_Shdr) : sizeof(Elf32_Shdr);
+    if (header.e_shentsize < shdr_size) {
+      THROWF("ELF section header entry size too small: $0",
+             header.e_shentsize);
+    }
+    if (count == 0) {
+      // The real count overflowed into section 0.
+      data = PreadRegion(fd, file_size, header.e_shoff, header.e_shentsize);
+      Elf64_Shdr section0;
+      StructReader(is_64bit, is_native_endian, data)
+          .Read<Elf32_Shdr>(0, ShdrMunger(), nullptr, &section0);
+      count = section0.sh_size;
+    }
+    data = PreadRegion(fd, file_size, header.e_shoff,
+                       CheckedMul(header.e_shentsize, count));
+    StructReader reader(is_64bit, is_native_endian, data);
+    for (Elf64_Xword i = 1; i < count; i++) {
+      Elf64_Shdr section;
+      reader.Read<Elf32_Shdr>(i * header.e_shentsize, ShdrMunger(), nullptr,
+                              &section);
+      if (section.sh_type == SHT_NOTE &&
+          find_build_id(section.sh_offset, section.sh_size)) {
+        return true;
+      }
     }
   }
-  return false;
+
+  if (header.e_phnum > 0) {
+    data = PreadRegion(fd, file_size, header.e_phoff,
+                       CheckedMul(header.e_phentsize, header.e_phnum));
+    StructReader reader(is_64bit, is_native_endian, data);
+    for (Elf64_Xword i = 0; i < header.e_phnum; i++) {
+      Elf64_Phdr segment;
+      reader.Read<Elf32_Phdr>(i * header.e_phentsize, PhdrMunger(), nullptr,
+                              &segment);
+      if (segment.p_type == PT_NOTE &&
+          find_build_id(segment.p_offset, segment.p_filesz)) {
+        return true;
+      }
+    }
+  }
+
+  return true;
 }
 
 
@@ -749,84 +1012,212 @@ void MaybeAddFileRange(const char* analyzer, RangeSink* sink, string_view label,
   }
 }
 
-// Iterate over each ELF file, agnostic to whether it is inside a .a (AR) file
-// or not.
-template <class Func>
-void ForEachElf(const InputFile& file, RangeSink* sink, Func func) {
+// ElfInput ////////////////////////////////////////////////////////////////////
+
+// An input file that is either a single ELF file or an AR archive of them,
+// parsed once so that every reader of the file can share the result.
+
+class ElfInput {
+ public:
+  ElfInput(const InputFile& file);
+
+  const InputFile& file() const { return file_; }
+  bool is_archive() const { return is_archive_; }
+
+  // Archives count as object files, since their members are object files.
+  bool is_object() const { return is_object_; }
+
+  // The ELF file, for inputs that are not archives.
+  const ElfFile* elf() const { return elf_.get(); }
+
+  // Sections in object files don't have addresses yet, so we give every
+  // section of every member its own range of a flat VM address space.  This
+  // returns the VM address for offset |addr| in section |ndx| of |elf|, where
+  // |elf| and |index_base| are as passed to the ForEachElf() callback.  For
+  // binaries and shared libraries it just returns |addr|.
+  uint64_t ToVMAddr(uint64_t addr, const ElfFile& elf, uint64_t index_base,
+                    uint64_t ndx) const;
+
+  // Iterate over each ELF file, agnostic to whether it is inside a .a (AR) file
+  // or not.
+  template <class Func>
+  void ForEachElf(RangeSink* sink, Func func) const;
+
+  // Like ForEachElf(), but archive members may be visited in parallel.  |func|
+  // takes an extra RangeSink* argument, which it must use instead of |sink|;
+  // the ranges it adds reach |sink| in member order, as with ForEachElf().
+  // |func| must not have any other side effects that depend on order.
+  template <class Func>
+  void ForEachElfInParallel(RangeSink* sink, Func func) const;
+
+ private:
+  BLOATY_DISALLOW_COPY_AND_ASSIGN(ElfInput);
+
+  struct Member {
+    ArFile::MemberFile file;
+    std::unique_ptr<ElfFile> elf;  // NULL if this is not an ELF member.
+    uint64_t index_base;
+  };
+
+  // Assigns VM ranges to the sections of |elf|, returning the index_base to
+  // use for it.
+  uint64_t LayOutSections(const ElfFile& elf);
+
+  // Adds the AR ranges for |member| to |sink|, calling |func| for the ELF
+  // file if it is one.
+  template <class Func>
+  static void VisitMember(const Member& member, RangeSink* sink, Func func);
+
+  const InputFile& file_;
+  bool is_archive_;
+  bool is_object_;
+  string_view ar_magic_;
+  std::vector<Member> members_;
+  std::unique_ptr<ElfFile> elf_;
+
+  // For object files, the VM address of each section, indexed by index_base
+  // plus the section index.  Symbols in pseudo-sections like SHN_ABS go after
+  // all of them, at sections_end_, where nothing is mapped.
+  std::vector<uint64_t> section_bases_;
+  uint64_t sections_end_ = 0;
+};
+
+ElfInput::ElfInput(const InputFile& file) : file_(file) {
   ArFile ar_file(file.data());
-  unsigned long index_base = 0;
+  is_archive_ = ar_file.IsOpen();
 
-  if (ar_file.IsOpen()) {
-    ArFile::MemberFile member;
+  if (is_archive_) {
     ArFile::MemberReader reader(ar_file);
-
-    MaybeAddFileRange("ar_archive", sink, "[AR Headers]", ar_file.magic());
-
-    while (reader.ReadMember(&member)) {
-      MaybeAddFileRange("ar_archive", sink, "[AR Headers]", member.header);
-      switch (member.file_type) {
-        case ArFile::MemberFile::kNormal: {
-          ElfFile elf(member.contents);
-          if (elf.IsOpen()) {
-            func(elf, member.filename, index_base);
-            index_base += elf.section_count();
-          } else {
-            MaybeAddFileRange("ar_archive", sink, "[AR Non-ELF Member File]",
-                              member.contents);
-          }
-          break;
+    ar_magic_ = ar_file.magic();
+    while (true) {
+      Member member;
+      if (!reader.ReadMember(&member.file)) {
+        break;
+      }
+      member.index_base = 0;
+      if (member.file.file_type == ArFile::MemberFile::kNormal) {
+        member.elf.reset(new ElfFile(member.file.contents));
+        if (member.elf->IsOpen()) {
+          member.index_base = LayOutSections(*member.elf);
+        } else {
+          member.elf.reset();
         }
-        case ArFile::MemberFile::kSymbolTable:
-          MaybeAddFileRange("ar_archive", sink, "[AR Symbol Table]",
-                            member.contents);
-          break;
-        case ArFile::MemberFile::kLongFilenameTable:
-          MaybeAddFileRange("ar_archive", sink, "[AR Headers]",
-                            member.contents);
-          break;
       }
+      members_.push_back(std::move(member));
     }
+    is_object_ = true;
   } else {
-    ElfFile elf(file.data());
-    if (!elf.IsOpen()) {
+    elf_.reset(new ElfFile(file.data()));
+    if (!elf_->IsOpen()) {
       THROWF("Not an ELF or Archive file: $0", file.filename());
     }
+    is_object_ = elf_->header().e_type == ET_REL;
+    if (is_object_) {
+      LayOutSections(*elf_);
+    }
+  }
+}
 
-    func(elf, file.filename(), index_base);
+uint64_t ElfInput::LayOutSections(const ElfFile& elf) {
+  uint64_t index_base = section_bases_.size();
+  for (Elf64_Xword i = 0; i < elf.section_count(); i++) {
+    section_bases_.push_back(sections_end_);
+    // Keep every section at least one granule apart, so that a symbol that
+    // runs past the end of its section doesn't reach into the next one.
+    uint64_t size = AlignUp(elf.section_header(i).sh_size, 16);
+    sections_end_ = CheckedAdd(sections_end_, CheckedAdd(size, 16));
   }
+  return index_base;
 }
 
-// For object files, addresses are relative to the section they live in, which
-// is indicated by ndx.  We split this into:
-//
-// - 24 bits for index (up to 16M symbols with -ffunction-sections)
-// - 40 bits for address (up to 1TB section)
-static uint64_t ToVMAddr(size_t addr, long ndx, bool is_object) {
-  if (is_object) {
-    if (ndx >= 1 << 24) {
-      THROW("ndx overflow: too many sections");
+uint64_t ElfInput::ToVMAddr(uint64_t addr, const ElfFile& elf,
+                            uint64_t index_base, uint64_t ndx) const {
+  if (!is_object_) {
+    return addr;
+  }
+  uint64_t base = ndx < elf.section_count() ? section_bases_[index_base + ndx]
+                                            : sections_end_;
+  return CheckedAdd(base, addr);
+}
+
+template <class Func>
+void ElfInput::VisitMember(const Member& member, RangeSink* sink, Func func) {
+  MaybeAddFileRange("ar_archive", sink, "[AR Headers]", member.file.header);
+  switch (member.file.file_type) {
+    case ArFile::MemberFile::kNormal: {
+      if (member.elf) {
+        func(member);
+      } else {
+        MaybeAddFileRange("ar_archive", sink, "[AR Non-ELF Member File]",
+                          member.file.contents);
+      }
+      break;
     }
-    if (addr >= 1UL << 40) {
-      THROW("address overflow: section too big");
+    case ArFile::MemberFile::kSymbolTable:
+      MaybeAddFileRange("ar_archive", sink, "[AR Symbol Table]",
+                        member.file.contents);
+      break;
+    case ArFile::MemberFile::kLongFilenameTable:
+      MaybeAddFileRange("ar_archive", sink, "[AR Headers]",
+                        member.file.contents);
+      break;
+  }
+}
+
+template <class Func>
+void ElfInput::ForEachElf(RangeSink* sink, Func func) const {
+  if (is_archive_) {
+    MaybeAddFileRange("ar_archive", sink, "[AR Headers]", ar_magic_);
+    for (const auto& member : members_) {
+      VisitMember(member, sink, [&func](const Member& elf_member) {
+        func(*elf_member.elf, elf_member.file.filename, elf_member.index_base);
+      });
     }
-    return (ndx << 40) | addr;
   } else {
-    return addr;
+    func(*elf_, file_.filename(), 0);
   }
 }
 
-static bool IsArchiveFile(string_view data) {
-  ArFile ar(data);
-  return ar.IsOpen();
-}
+template <class Func>
+void ElfInput::ForEachElfInParallel(RangeSink* sink, Func func) const {
+  assert(sink);
+  if (!is_archive_ || std::thread::hardware_concurrency() <= 1) {
+    ForEachElf(sink, [sink, &func](const ElfFile& elf, string_view filename,
+                                   uint64_t index_base) {
+      func(elf, filename, index_base, sink);
+    });
+    return;
+  }
+
+  // Each member's ranges are recorded and then replayed into |sink| in member
+  // order.  We go through the archive a window at a time so that we don't hold
+  // the recorded ranges for every member at once.
+  constexpr size_t kWindowSize = 256;
+  MaybeAddFileRange("ar_archive", sink, "[AR Headers]", ar_magic_);
+
+  for (size_t start = 0; start < members_.size(); start += kWindowSize) {
+    size_t count = std::min(kWindowSize, members_.size() - start);
+    std::vector<std::unique_ptr<RangeSink>> recorders(count);
+
+    ParallelForEach(count, [&](size_t i) {
+      const Member& member = members_[start + i];
+      if (member.elf) {
+        recorders[i] = RangeSink::CreateRecorder(*sink);
+        func(*member.elf, member.file.filename, member.index_base,
+             recorders[i].get());
+      }
+    });
 
-static bool IsObjectFile(string_view data) {
-  ElfFile elf(data);
-  return IsArchiveFile(data) || (elf.IsOpen() && elf.header().e_type == ET_REL);
+    for (size_t i = 0; i < count; i++) {
+      VisitMember(members_[start + i], sink, [&](const Member&) {
+        recorders[i]->Replay(sink);
+      });
+    }
+  }
 }
 
-static void CheckNotObject(const char* source, RangeSink* sink) {
-  if (IsObjectFile(sink->input_file().data())) {
+static void CheckNotObject(const char* source, const ElfInput& input) {
+  if (input.is_object()) {
     THROWF(
         "can't use data source '$0' on object files (only binaries and shared "
         "libraries)",
@@ -880,91 +1271,120 @@ static void ElfMachineToCapstone(Elf64_Half e_machine, cs_arch* arch,
   }
 }
 
-static void ReadElfArchMode(const InputFile& file, cs_arch* arch, cs_mode* mode) {
-  ForEachElf(file, nullptr,
+static void ReadElfArchMode(const ElfInput& input, cs_arch* arch,
+                            cs_mode* mode) {
+  input.ForEachElf(nullptr,
              [=](const ElfFile& elf, string_view /*filename*/,
-                 uint32_t /*index_base*/) {
+                 uint64_t /*index_base*/) {
                // Last .o file wins?  (For .a files)?  It's kind of arbitrary,
                // but a single .a file shouldn't have multiple archs in it.
                ElfMachineToCapstone(elf.header().e_machine, arch, mode);
              });
 }
 
-static void ReadELFSymbols(const InputFile& file, RangeSink* sink,
-                           SymbolTable* table, bool disassemble) {
-  bool is_object = IsObjectFile(file.data());
-  DisassemblyInfo info;
-  DisassemblyInfo* infop = &info;
-  ReadElfArchMode(file, &info.arch, &info.mode);
+// If |refs| is non-NULL, functions are disassembled and the data references
+// they contain are appended to |refs| instead of adding the symbols to |sink|.
+static void ReadELFSymbols(const ElfInput& input, RangeSink* sink,
+                           SymbolTable* table,
+                           std::vector<DisassemblyReference>* refs) {
+  bool disassemble = refs != nullptr;
+  cs_arch arch;
+  cs_mode mode;
+  ReadElfArchMode(input, &arch, &mode);
+
+  auto read_symbols = [=, &input](const ElfFile& elf,
+                                  string_view /*filename*/,
+                          uint64_t index_base, RangeSink* sink) {
+    for (Elf64_Xword i = 1; i < elf.section_count(); i++) {
+      ElfFile::Section section;
+      elf.ReadSection(i, &section);
 
-  ForEachElf(
-      file, sink,
-      [=](const ElfFile& elf, string_view /*filename*/, uint32_t index_base) {
-        for (Elf64_Xword i = 1; i < elf.section_count(); i++) {
-          ElfFile::Section section;
-          elf.ReadSection(i, &section);
+      if (section.header().sh_type != SHT_SYMTAB) {
+        continue;
+      }
 
-          if (section.header().sh_type != SHT_SYMTAB) {
-            continue;
-          }
+      // Find the corresponding section where the strings for the symbol
+      // table can be found.
+      ElfFile::Section strtab_section;
+      elf.ReadSection(section.header().sh_link, &strtab_section);
+      if (strtab_section.header().sh_type != SHT_STRTAB) {
+        THROW("symtab section pointed to non-strtab section");
+      }
 
-          Elf64_Word symbol_count = section.GetEntryCount();
+      // Demangling dominates the cost of reading a large symbol table, so
+      // we collect the names for the sink first and demangle them all at
+      // once in parallel, then add them to the sink in symbol table order.
+      std::vector<std::pair<uint64_t, uint64_t>> sink_ranges;
+      std::vector<string_view> sink_names;
+
+      // Likewise for disassembly: (start address, text) of each function.
+      std::vector<std::pair<uint64_t, string_view>> functions;
+
+      std::vector<Elf64_Sym> syms;
+      section.ReadSymbols(
+          [](const Elf64_Sym& sym) {
+            // For zero-sized symbols, maybe try to refine?  See
+            // ReadELFSectionsRefineSymbols below.
+            return ELF64_ST_TYPE(sym.st_info) != STT_SECTION &&
+                   sym.st_shndx != STN_UNDEF && sym.st_size != 0;
+          },
+          &syms);
+
+      if (table) {
+        table->Reserve(table->size() + syms.size());
+      }
 
-          // Find the corresponding section where the strings for the symbol
-          // table can be found.
-          ElfFile::Section strtab_section;
-          elf.ReadSection(section.header().sh_link, &strtab_section);
-          if (strtab_section.header().sh_type != SHT_STRTAB) {
-            THROW("symtab section pointed to non-strtab section");
+      for (const Elf64_Sym& sym : syms) {
+        string_view name = strtab_section.ReadString(sym.st_name);
+        uint64_t full_addr =
+            input.ToVMAddr(sym.st_value, elf, index_base, sym.st_shndx);
+        if (sink && !disassemble) {
+          sink_ranges.emplace_back(full_addr, sym.st_size);
+          sink_names.push_back(name);
+        }
+        if (table) {
+          table->Insert(name, full_addr, sym.st_size);
+        }
+        if (disassemble && ELF64_ST_TYPE(sym.st_info) == STT_FUNC) {
+          if (verbose_level > 1) {
+            printf("Disassembling function: %s\n", name.data());
           }
+          functions.emplace_back(
+              full_addr,
+              sink->TranslateVMToFile(full_addr).substr(0, sym.st_size));
+        }
+      }
 
-          for (Elf64_Word i = 1; i < symbol_count; i++) {
-            Elf64_Sym sym;
-
-            section.ReadSymbol(i, &sym, nullptr);
-
-            if (ELF64_ST_TYPE(sym.st_info) == STT_SECTION) {
-              continue;
-            }
-
-            if (sym.st_shndx == STN_UNDEF) {
-              continue;
-            }
-
-            if (sym.st_size == 0) {
-              // Maybe try to refine?  See ReadELFSectionsRefineSymbols below.
-              continue;
-            }
+      if (!functions.empty()) {
+        DisassembleFindReferencesAll(arch, mode, functions, refs);
+      }
 
-            string_view name = strtab_section.ReadString(sym.st_name);
-            uint64_t full_addr =
-                ToVMAddr(sym.st_value, index_base + sym.st_shndx, is_object);
-            if (sink && !disassemble) {
-              sink->AddVMRangeAllowAlias(
-                  "elf_symbols", full_addr, sym.st_size,
-                  ItaniumDemangle(name, sink->data_source()));
-            }
-            if (table) {
-              table->insert(
-                  std::make_pair(name, std::make_pair(full_addr, sym.st_size)));
-            }
-            if (disassemble && ELF64_ST_TYPE(sym.st_info) == STT_FUNC) {
-              if (verbose_level > 1) {
-                printf("Disassembling function: %s\n", name.data());
-              }
-              infop->text = sink->TranslateVMToFile(full_addr).substr(0, sym.st_size);
-              infop->start_address = full_addr;
-              DisassembleFindReferences(*infop, sink);
-            }
-          }
+      if (!sink_names.empty()) {
+        std::vector<std::string> demangled =
+            ItaniumDemangleAll(sink_names, sink->demangle_source());
+        for (size_t j = 0; j < sink_names.size(); j++) {
+          sink->AddVMRangeAllowAlias("elf_symbols", sink_ranges[j].first,
+                                     sink_ranges[j].second, demangled[j]);
         }
-      });
+      }
+    }
+  };
+
+  if (table || refs) {
+    // These are shared by all members, so they have to be filled in order.
+    input.ForEachElf(sink, [&](const ElfFile& elf, string_view filename,
+                               uint64_t index_base) {
+      read_symbols(elf, filename, index_base, sink);
+    });
+  } else {
+    input.ForEachElfInParallel(sink, read_symbols);
+  }
 }
 
-static void ReadELFSymbolTableEntries(const ElfFile& elf,
+static void ReadELFSymbolTableEntries(const ElfInput& input,
+                                      const ElfFile& elf,
                                       const ElfFile::Section& section,
-                                      uint64_t index_base, bool is_object,
-                                      RangeSink* sink) {
+                                      uint64_t index_base, RangeSink* sink) {
   Elf64_Word symbol_count = section.GetEntryCount();
 
   // Find the corresponding section where the strings for the symbol
@@ -988,7 +1408,7 @@ static void ReadELFSymbolTableEntries(const ElfFile& elf,
 
     string_view name = strtab_section.ReadString(sym.st_name);
     uint64_t full_addr =
-        ToVMAddr(sym.st_value, index_base + sym.st_shndx, is_object);
+        input.ToVMAddr(sym.st_value, elf, index_base, sym.st_shndx);
     // Capture the trailing NULL.
     name = string_view(name.data(), name.size() + 1);
     sink->AddFileRangeForVMAddr("elf_symtab_name", full_addr, name);
@@ -996,9 +1416,9 @@ static void ReadELFSymbolTableEntries(const ElfFile& elf,
   }
 }
 
-static void ReadELFRelaEntries(const ElfFile::Section& section,
-                               uint64_t index_base, bool is_object,
-                               RangeSink* sink) {
+static void ReadELFRelaEntries(const ElfInput& input, const ElfFile& elf,
+                               const ElfFile::Section& section,
+                               uint64_t index_base, RangeSink* sink) {
   Elf64_Word rela_count = section.GetEntryCount();
   Elf64_Word sh_info = section.header().sh_info;
   for (Elf64_Word i = 1; i < rela_count; i++) {
@@ -1006,7 +1426,7 @@ static void ReadELFRelaEntries(const ElfFile::Section& section,
     string_view rela_range;
     section.ReadRelocationWithAddend(i, &rela, &rela_range);
     uint64_t full_addr =
-        ToVMAddr(rela.r_offset, index_base + sh_info, is_object);
+        input.ToVMAddr(rela.r_offset, elf, index_base, sh_info);
     sink->AddFileRangeForVMAddr("elf_rela", full_addr, rela_range);
   }
 }
@@ -1017,17 +1437,21 @@ static void ReadELFRelaEntries(const ElfFile::Section& section,
 //   .strtab
 //   .dynsym
 //   .dynstr
-static void ReadELFTables(const InputFile& file, RangeSink* sink) {
-  bool is_object = IsObjectFile(file.data());
-
-  // Disassemble first, because sometimes other tables will refer to things we
-  // discovered through disassembling.
-  ReadELFSymbols(file, sink, nullptr, true);
+//
+// |refs| are the references found by disassembling the file's functions.
+static void ReadELFTables(const ElfInput& input, RangeSink* sink,
+                          const std::vector<DisassemblyReference>& refs) {
+  // Add references first, because sometimes other tables will refer to things
+  // we discovered through disassembling.
+  for (const auto& ref : refs) {
+    sink->AddVMRangeForVMAddr("x86_disassemble", ref.from_address,
+                              ref.to_address, RangeSink::kUnknownSize);
+  }
 
   // Now scan other tables.
-  ForEachElf(file, sink,
-             [sink, is_object](const ElfFile& elf, string_view /*filename*/,
-                               uint32_t index_base) {
+  input.ForEachElfInParallel(sink,
+             [&input](const ElfFile& elf, string_view /*filename*/,
+                      uint64_t index_base, RangeSink* sink) {
                for (Elf64_Xword i = 1; i < elf.section_count(); i++) {
                  ElfFile::Section section;
                  elf.ReadSection(i, &section);
@@ -1035,11 +1459,11 @@ static void ReadELFTables(const InputFile& file, RangeSink* sink) {
                  switch (section.header().sh_type) {
                    case SHT_SYMTAB:
                    case SHT_DYNSYM:
-                     ReadELFSymbolTableEntries(elf, section, index_base,
-                                               is_object, sink);
+                     ReadELFSymbolTableEntries(input, elf, section,
+                                               index_base, sink);
                      break;
                    case SHT_RELA:
-                     ReadELFRelaEntries(section, index_base, is_object, sink);
+                     ReadELFRelaEntries(input, elf, section, index_base, sink);
                      break;
                  }
 
@@ -1064,11 +1488,12 @@ enum ReportSectionsBy {
   kReportByArchiveMember,
 };
 
-static void DoReadELFSections(RangeSink* sink, enum ReportSectionsBy report_by) {
-  bool is_object = IsObjectFile(sink->input_file().data());
-  ForEachElf(
-      sink->input_file(), sink,
-      [=](const ElfFile& elf, string_view filename, uint32_t index_base) {
+static void DoReadELFSections(const ElfInput& input, RangeSink* sink,
+                              enum ReportSectionsBy report_by) {
+  input.ForEachElfInParallel(
+      sink,
+      [=, &input](const ElfFile& elf, string_view filename, uint64_t index_base,
+          RangeSink* sink) {
         std::string name_from_flags;
         for (Elf64_Xword i = 1; i < elf.section_count(); i++) {
           ElfFile::Section section;
@@ -1087,7 +1512,7 @@ static void DoReadELFSections(RangeSink* sink, enum ReportSectionsBy report_by)
 
           string_view contents = StrictSubstr(section.contents(), 0, filesize);
 
-          uint64_t full_addr = ToVMAddr(addr, index_base + i, is_object);
+          uint64_t full_addr = input.ToVMAddr(addr, elf, index_base, i);
 
           if (report_by == kReportByFlags) {
             name_from_flags = std::string(name);
@@ -1137,10 +1562,11 @@ enum ReportSegmentsBy {
   kReportByEscapedSegmentName,
 };
 
-static void DoReadELFSegments(RangeSink* sink, ReportSegmentsBy report_by) {
-  ForEachElf(sink->input_file(), sink,
+static void DoReadELFSegments(const ElfInput& input, RangeSink* sink,
+                              ReportSegmentsBy report_by) {
+  input.ForEachElf(sink,
              [=](const ElfFile& elf, string_view /*filename*/,
-                 uint32_t /*index_base*/) {
+                 uint64_t /*index_base*/) {
                for (Elf64_Xword i = 0; i < elf.header().e_phnum; i++) {
                  ElfFile::Segment segment;
                  elf.ReadSegment(i, &segment);
@@ -1187,9 +1613,9 @@ static void DoReadELFSegments(RangeSink* sink, ReportSegmentsBy report_by) {
                                 header.p_memsz, segment.contents());
                }
              });
-  ForEachElf(sink->input_file(), sink,
+  input.ForEachElf(sink,
              [=](const ElfFile& elf, string_view /*filename*/,
-                 uint32_t /*index_base*/) {
+                 uint64_t /*index_base*/) {
                for (Elf64_Xword i = 0; i < elf.header().e_phnum; i++) {
                  ElfFile::Segment segment;
                  elf.ReadSegment(i, &segment);
@@ -1202,66 +1628,282 @@ static void DoReadELFSegments(RangeSink* sink, ReportSegmentsBy report_by) {
              });
 }
 
-static void ReadELFSegments(RangeSink* sink) {
-  if (IsObjectFile(sink->input_file().data())) {
+static void ReadELFSegments(const ElfInput& input, RangeSink* sink) {
+  if (input.is_object()) {
     // Object files don't actually have segments.  But we can cheat a little bit
     // and make up "segments" based on section flags.  This can be really useful
     // when you are compiling with -ffunction-sections and -fdata-sections,
     // because in those cases the actual "sections" report becomes pretty
     // useless (since every function/data has its own section, it's like the
     // "symbols" report except less readable).
-    DoReadELFSections(sink, kReportByFlags);
+    DoReadELFSections(input, sink, kReportByFlags);
+  } else {
+    DoReadELFSegments(input, sink, kReportBySegmentName);
+  }
+}
+
+// Decompressed output goes into a buffer that starts small and doubles as
+// output arrives, up to the |size| the header claims.  A corrupt header can
+// claim any size, so we must not allocate it up front.  Returns false if the
+// allocation fails.
+static bool GrowDecompressBuffer(uint64_t used, uint64_t size,
+                                 std::unique_ptr<char[]>* buf,
+                                 uint64_t* capacity) {
+  uint64_t new_capacity =
+      std::min(size, std::max<uint64_t>(*capacity * 2, 64 * 1024));
+  std::unique_ptr<char[]> new_buf(new (std::nothrow) char[new_capacity]);
+  if (!new_buf) {
+    return false;
+  }
+  if (used > 0) {
+    memcpy(new_buf.get(), buf->get(), used);
+  }
+  *buf = std::move(new_buf);
+  *capacity = new_capacity;
+  return true;
+}
+
+// Returns a buffer holding |data| decompressed.  Throws unless the data
+// decompresses to exactly |size| bytes.
+static std::unique_ptr<char[]> DecompressSection(string_view name,
+                                                 uint32_t type,
+                                                 string_view data,
+                                                 uint64_t size) {
+  // Unused when bloaty is built without any decompressors.
+  (void)data;
+
+  if (size > SIZE_MAX) {
+    THROWF("bad uncompressed size for section $0", name);
+  }
+
+  std::unique_ptr<char[]> out;
+  switch (type) {
+    case ELFCOMPRESS_ZLIB: {
+#ifdef BLOATY_HAVE_ZLIB
+      // Deflate can't do better than about 1032:1, so anything claiming more
+      // is corrupt.
+      if (size / 1032 > data.size()) {
+        THROWF("bad uncompressed size for section $0", name);
+      }
+      uint64_t capacity = 0;
+      uint64_t used = 0;
+      bool alloc_failed = false;
+      z_stream stream;
+      memset(&stream, 0, sizeof(stream));
+      if (inflateInit(&stream) != Z_OK) {
+        THROWF("couldn't initialize zlib to decompress section $0", name);
+      }
+      stream.next_in =
+          reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+      uint64_t in_left = data.size();
+      int ret = Z_OK;
+      while (ret == Z_OK) {
+        if (used == capacity && capacity < size &&
+            !GrowDecompressBuffer(used, size, &out, &capacity)) {
+          alloc_failed = true;
+          break;
+        }
+        // zlib counts in uInt, so very large sections are fed in pieces.
+        uInt avail_in = std::min<uint64_t>(in_left, UINT_MAX);
+        uInt avail_out = std::min<uint64_t>(capacity - used, UINT_MAX);
+        stream.next_out = reinterpret_cast<Bytef*>(out.get() + used);
+        stream.avail_in = avail_in;
+        stream.avail_out = avail_out;
+        ret = inflate(&stream, Z_NO_FLUSH);
+        in_left -= avail_in - stream.avail_in;
+        used += avail_out - stream.avail_out;
+      }
+      inflateEnd(&stream);
+      if (alloc_failed) {
+        break;
+      }
+      if (ret != Z_STREAM_END || used != size) {
+        THROWF("corrupt zlib data in section $0", name);
+      }
+      return out;
+#else
+      THROWF("section $0 is compressed with zlib, but bloaty was built "
+             "without zlib support", name);
+#endif
+    }
+    case ELFCOMPRESS_ZSTD: {
+#ifdef BLOATY_HAVE_ZSTD
+      unsigned long long frame_size =
+          ZSTD_getFrameContentSize(data.data(), data.size());
+      if (frame_size == ZSTD_CONTENTSIZE_ERROR ||
+          (frame_size != ZSTD_CONTENTSIZE_UNKNOWN && frame_size != size)) {
+        THROWF("bad uncompressed size for section $0", name);
+      }
+      ZSTD_DStream* stream = ZSTD_createDStream();
+      if (!stream) {
+        THROWF("couldn't initialize zstd to decompress section $0", name);
+      }
+      uint64_t capacity = 0;
+      uint64_t used = 0;
+      bool alloc_failed = false;
+      ZSTD_inBuffer in = {data.data(), data.size(), 0};
+      size_t ret = 0;
+      while (true) {
+        if (used == capacity && capacity < size &&
+            !GrowDecompressBuffer(used, size, &out, &capacity)) {
+          alloc_failed = true;
+          break;
+        }
+        ZSTD_outBuffer out_buf = {out.get(), capacity, used};
+        size_t in_pos = in.pos;
+        ret = ZSTD_decompressStream(stream, &out_buf, &in);
+        bool progress = in.pos != in_pos || out_buf.pos != used;
+        used = out_buf.pos;
+        // A return of 0 ends a frame, but the section may hold several.
+        if (ZSTD_isError(ret) || (ret == 0 && in.pos == in.size) ||
+            !progress) {
+          break;
+        }
+      }
+      ZSTD_freeDStream(stream);
+      if (alloc_failed) {
+        break;
+      }
+      if (ZSTD_isError(ret) || ret != 0 || in.pos != in.size ||
+          used != size) {
+        THROWF("corrupt zstd data in section $0", name);
+      }
+      return out;
+#else
+      THROWF("section $0 is compressed with zstd, but bloaty was built "
+             "without zstd support", name);
+#endif
+    }
+    default:
+      THROWF("section $0 has unknown compression type $1", name, type);
+  }
+
+  THROWF("couldn't allocate $0 bytes to decompress section $1", size, name);
+}
+
+static string_view* GetDWARFSection(string_view name, dwarf::File* dwarf) {
+  if (name == "aranges") {
+    return &dwarf->debug_aranges;
+  } else if (name == "str") {
+    return &dwarf->debug_str;
+  } else if (name == "info") {
+    return &dwarf->debug_info;
+  } else if (name == "types") {
+    return &dwarf->debug_types;
+  } else if (name == "abbrev") {
+    return &dwarf->debug_abbrev;
+  } else if (name == "line") {
+    return &dwarf->debug_line;
+  } else if (name == "loc") {
+    return &dwarf->debug_loc;
+  } else if (name == "pubnames") {
+    return &dwarf->debug_pubnames;
+  } else if (name == "pubtypes") {
+    return &dwarf->debug_pubtypes;
+  } else if (name == "ranges") {
+    return &dwarf->debug_ranges;
+  } else if (name == "str_offsets") {
+    return &dwarf->debug_str_offsets;
+  } else if (name == "line_str") {
+    return &dwarf->debug_line_str;
+  } else if (name == "addr") {
+    return &dwarf->debug_addr;
+  } else if (name == "rnglists") {
+    return &dwarf->debug_rnglists;
+  } else if (name == "loclists") {
+    return &dwarf->debug_loclists;
+  } else if (name == "cu_index") {
+    return &dwarf->debug_cu_index;
   } else {
-    DoReadELFSegments(sink, kReportBySegmentName);
+    return nullptr;
   }
 }
 
 // ELF files put debug info directly into the binary, so we call the DWARF
 // reader directly on them.  At the moment we don't attempt to make these
 // work with object files.
+//
+// Debug sections may be compressed, either with SHF_COMPRESSED or with the
+// older GNU convention of a ".zdebug_*" name and a "ZLIB" header.  These are
+// decompressed in parallel into buffers owned by |dwarf|.  Since those buffers
+// aren't part of the file, RangeSink ignores any file ranges the DWARF reader
+// finds in them, and the compressed bytes are attributed to their section.
+//
+// The split DWARF in .dwo files and .dwp packages is in sections like
+// ".debug_info.dwo", which we read just like ".debug_info".
+
+static void ReadDWARFSections(const ElfInput& input, dwarf::File* dwarf) {
+  assert(input.elf());
+  const ElfFile& elf = *input.elf();
+
+  struct CompressedSection {
+    string_view name;
+    string_view* dest;
+    uint32_t type;
+    string_view data;
+    uint64_t size;
+  };
+  std::vector<CompressedSection> compressed;
 
-static void ReadDWARFSections(const InputFile& file, dwarf::File* dwarf) {
-  ElfFile elf(file.data());
-  assert(elf.IsOpen());
   for (Elf64_Xword i = 1; i < elf.section_count(); i++) {
     ElfFile::Section section;
     elf.ReadSection(i, &section);
     string_view name = section.GetName();
+    string_view short_name = name;
+    bool gnu_compressed = absl::ConsumePrefix(&short_name, ".zdebug_");
 
-    if (name == ".debug_aranges") {
-      dwarf->debug_aranges = section.contents();
-    } else if (name == ".debug_str") {
-      dwarf->debug_str = section.contents();
-    } else if (name == ".debug_info") {
-      dwarf->debug_info = section.contents();
-    } else if (name == ".debug_types") {
-      dwarf->debug_types = section.contents();
-    } else if (name == ".debug_abbrev") {
-      dwarf->debug_abbrev = section.contents();
-    } else if (name == ".debug_line") {
-      dwarf->debug_line = section.contents();
-    } else if (name == ".debug_loc") {
-      dwarf->debug_loc = section.contents();
-    } else if (name == ".debug_pubnames") {
-      dwarf->debug_pubnames = section.contents();
-    } else if (name == ".debug_pubtypes") {
-      dwarf->debug_pubtypes = section.contents();
-    } else if (name == ".debug_ranges") {
-      dwarf->debug_ranges = section.contents();
+    if (!gnu_compressed && !absl::ConsumePrefix(&short_name, ".debug_")) {
+      continue;
+    }
+    absl::ConsumeSuffix(&short_name, ".dwo");
+
+    string_view* dest = GetDWARFSection(short_name, dwarf);
+    if (!dest) {
+      continue;
+    }
+
+    if (section.header().sh_flags & SHF_COMPRESSED) {
+      Elf64_Chdr chdr;
+      string_view data;
+      section.ReadCompressionHeader(&chdr, &data);
+      compressed.push_back({name, dest, chdr.ch_type, data, chdr.ch_size});
+    } else if (gnu_compressed) {
+      // "ZLIB" followed by the uncompressed size as a big-endian uint64.
+      string_view data = section.contents();
+      if (!absl::ConsumePrefix(&data, "ZLIB") || data.size() < 8) {
+        THROWF("bad header in compressed section $0", name);
+      }
+      uint64_t size = 0;
+      for (int j = 0; j < 8; j++) {
+        size = (size << 8) | static_cast<unsigned char>(data[j]);
+      }
+      compressed.push_back(
+          {name, dest, ELFCOMPRESS_ZLIB, data.substr(8), size});
+    } else {
+      *dest = section.contents();
     }
   }
-}
 
-void AddCatchAll(RangeSink* sink) {
-  // The last-line fallback to make sure we cover the entire VM space.
-  if (sink->data_source() != DataSource::kSegments) {
-    DoReadELFSections(sink, kReportByEscapedSectionName);
+  std::vector<std::unique_ptr<char[]>> buffers(compressed.size());
+  ParallelForEach(compressed.size(), [&compressed, &buffers](size_t i) {
+    const CompressedSection& section = compressed[i];
+    buffers[i] = DecompressSection(section.name, section.type, section.data,
+                                   section.size);
+  });
+
+  for (size_t i = 0; i < compressed.size(); i++) {
+    *compressed[i].dest = string_view(buffers[i].get(), compressed[i].size);
+    dwarf->decompressed_sections.push_back(std::move(buffers[i]));
   }
-  DoReadELFSegments(sink, kReportByEscapedSegmentName);
+}
+
+// The part of the catch-all that is the same for every data source.
+static void AddSegmentCatchAll(const ElfInput& input, RangeSink* sink) {
+  DoReadELFSegments(input, sink, kReportByEscapedSegmentName);
 
-  ForEachElf(sink->input_file(), sink,
+  input.ForEachElf(sink,
              [sink](const ElfFile& elf, string_view /*filename*/,
-                    uint32_t /*index_base*/) {
+                    uint64_t /*index_base*/) {
                sink->AddFileRange("elf_catchall", "[ELF Headers]",
                                   elf.header_region());
                sink->AddFileRange("elf_catchall", "[ELF Headers]",
@@ -1271,13 +1913,21 @@ void AddCatchAll(RangeSink* sink) {
              });
 
   // The last-line fallback to make sure we cover the entire file.
-  sink->AddFileRange("elf_catchall", "[Unmapped]", sink->input_file().data());
+  sink->AddFileRange("elf_catchall", "[Unmapped]", input.file().data());
+}
+
+void AddCatchAll(const ElfInput& input, RangeSink* sink) {
+  // The last-line fallback to make sure we cover the entire VM space.
+  if (sink->data_source() != DataSource::kSegments) {
+    DoReadELFSections(input, sink, kReportByEscapedSectionName);
+  }
+  AddSegmentCatchAll(input, sink);
 }
 
 class ElfObjectFile : public ObjectFile {
  public:
   ElfObjectFile(std::unique_ptr<InputFile> file, std::optional<std::string> link_map_file)
-      : ObjectFile(std::move(file)) {
+      : ObjectFile(std::move(file)), input_(file_data()) {
     if (link_map_file.has_value()) {
       std::ifstream infile(*link_map_file);
       std::string link_map;
@@ -1299,13 +1949,12 @@ class ElfObjectFile : public ObjectFile {
   }
 
   std::string GetBuildId() const override {
-    if (IsObjectFile(file_data().data())) {
+    if (input_.is_object()) {
       // Object files don't have a build ID.
       return std::string();
     }
 
-    ElfFile elf(file_data().data());
-    assert(elf.IsOpen());
+    const ElfFile& elf = *input_.elf();
     // Search for a build-id section.
     for (Elf64_Xword i = 1; i < elf.section_count(); i++) {
       ElfFile::Section section;
@@ -1343,7 +1992,7 @@ class ElfObjectFile : public ObjectFile {
     if (!link_map_symbols_.has_value()) return;
     const auto& symbols = *link_map_symbols_;
     for (const auto& symbol : symbols) {
-      auto demangled = ItaniumDemangle(symbol.name, sink->data_source());
+      auto demangled = ItaniumDemangle(symbol.name, sink->demangle_source());
       sink->AddVMRange("link_map", symbol.addr, symbol.size, demangled);
     }
 
@@ -1380,26 +2029,56 @@ class ElfObjectFile : public ObjectFile {
     return std::move(symbol_to_crate_);
   }
 
+  // Disassembling is expensive, so we only find the references in this file's
+  // functions once and replay them into every sink that needs them.
+  const std::vector<DisassemblyReference>& GetReferences(
+      RangeSink* sink) const {
+    if (!references_.has_value()) {
+      references_.emplace();
+      if (!sink->options().skip_disassembly_refs()) {
+        ReadELFSymbols(input_, sink, nullptr, &*references_);
+      }
+    }
+    return *references_;
+  }
+
   void ProcessFile(const std::vector<RangeSink*>& sinks) const override {
+    // The symbol/string tables and the catch-all ranges are the same for
+    // every data source, so instead of walking the file again for each sink
+    // we read them once into sinks that fan out to several sinks' outputs.
+    // Every output still sees its ranges in the same order as before.
+    std::unique_ptr<RangeSink> table_sink;
+    std::unique_ptr<RangeSink> section_sink;
+    std::unique_ptr<RangeSink> catchall_sink;
+    auto add_to = [&sinks](std::unique_ptr<RangeSink>* combined,
+                           const RangeSink* sink) {
+      if (!*combined) {
+        combined->reset(new RangeSink(&sink->input_file(), sink->options(),
+                                      sink->data_source(),
+                                      &sinks[0]->MapAtIndex(0)));
+      }
+      (*combined)->AddOutputs(*sink);
+    };
+
     for (auto sink : sinks) {
       switch (sink->data_source()) {
         case DataSource::kSegments:
-          ReadELFSegments(sink);
+          ReadELFSegments(input_, sink);
           break;
         case DataSource::kSections:
-          DoReadELFSections(sink, kReportBySectionName);
+          DoReadELFSections(input_, sink, kReportBySectionName);
           break;
         case DataSource::kRawSymbols:
         case DataSource::kShortSymbols:
         case DataSource::kFullSymbols:
           ReadLinkMapSymbols(sink);
-          ReadELFSymbols(debug_file().file_data(), sink, nullptr, false);
+          ReadELFSymbols(debug_input(), sink, nullptr, nullptr);
           break;
         case DataSource::kArchiveMembers:
-          DoReadELFSections(sink, kReportByArchiveMember);
+          DoReadELFSections(input_, sink, kReportByArchiveMember);
           break;
         case DataSource::kCompileUnits: {
-          CheckNotObject("compileunits", sink);
+          CheckNotObject("compileunits", input_);
           SymbolTable symtab;
           DualMap symbol_map;
           NameMunger empty_munger;
@@ -1408,38 +2087,59 @@ class ElfObjectFile : public ObjectFile {
                                 DataSource::kRawSymbols,
                                 &sinks[0]->MapAtIndex(0));
           symbol_sink.AddOutput(&symbol_map, &empty_munger);
-          ReadELFSymbols(debug_file().file_data(), &symbol_sink, &symtab,
-                         false);
-          dwarf::File dwarf;
-          ReadDWARFSections(debug_file().file_data(), &dwarf);
-          ReadDWARFCompileUnits(dwarf, symtab, symbol_map, sink);
+          // Only the DIEs that fast mode skips are looked up in the symbols.
+          if (sink->options().dwarf_mode() != Options::DWARF_MODE_FAST) {
+            ReadELFSymbols(debug_input(), &symbol_sink, &symtab, nullptr);
+          }
+          ReadDWARFCompileUnits(dwarf(), split_dwarf(), symtab, symbol_map,
+                                sink);
           ReadLinkMapCompileUnits(sink);
           break;
         }
         case DataSource::kInlines: {
-          CheckNotObject("lineinfo", sink);
-          dwarf::File dwarf;
-          ReadDWARFSections(debug_file().file_data(), &dwarf);
-          ReadDWARFInlines(dwarf, sink, true);
-          DoReadELFSections(sink, kReportByEscapedSectionName);
+          CheckNotObject("lineinfo", input_);
+          ReadDWARFInlines(dwarf(), sink, true);
+          DoReadELFSections(input_, sink, kReportByEscapedSectionName);
           break;
         }
         default:
           THROW("unknown data source");
       }
 
+      if (sink->IsBaseMap()) {
+        // All other sinks translate through the base map, so it has to be
+        // complete before we read anything on their behalf.
+        AddCatchAll(input_, sink);
+        continue;
+      }
+
       switch (sink->data_source()) {
         case DataSource::kSegments:
         case DataSource::kSections:
         case DataSource::kArchiveMembers:
           break;
         default:
-          // Add these *after* processing all other data sources.
-          ReadELFTables(sink->input_file(), sink);
+          add_to(&table_sink, sink);
           break;
       }
 
-      AddCatchAll(sink);
+      if (sink->data_source() != DataSource::kSegments) {
+        add_to(&section_sink, sink);
+      }
+      add_to(&catchall_sink, sink);
+    }
+
+    // Add these *after* processing all other data sources.
+    if (table_sink) {
+      ReadELFTables(input_, table_sink.get(),
+                    GetReferences(table_sink.get()));
+    }
+    if (section_sink) {
+      DoReadELFSections(input_, section_sink.get(),
+                        kReportByEscapedSectionName);
+    }
+    if (catchall_sink) {
+      AddSegmentCatchAll(input_, catchall_sink.get());
     }
   }
 
@@ -1467,19 +2167,18 @@ class ElfObjectFile : public ObjectFile {
     RangeSink symbol_sink(&file_data(), bloaty::Options(), symbol_source,
                           &base_map);
     symbol_sink.AddOutput(&info->symbol_map, &empty_munger);
-    ReadELFSymbols(debug_file().file_data(), &symbol_sink, &symbol_table,
-                   false);
+    ReadELFSymbols(debug_input(), &symbol_sink, &symbol_table, nullptr);
 
     if (symbol) {
-      auto entry = symbol_table.find(*symbol);
-      if (entry == symbol_table.end()) {
-        entry = symbol_table.find(ItaniumDemangle(*symbol, symbol_source));
-        if (entry == symbol_table.end()) {
+      const SymbolTable::Entry* entry = symbol_table.Find(*symbol);
+      if (!entry) {
+        entry = symbol_table.Find(ItaniumDemangle(*symbol, symbol_source));
+        if (!entry) {
           return false;
         }
       }
-      uint64_t vmaddr = entry->second.first;
-      uint64_t size = entry->second.second;
+      uint64_t vmaddr = entry->addr;
+      uint64_t size = entry->size;
 
       // TODO(haberman); Add PLT entries to symbol map, so call <plt stub> gets
       // symbolized.
@@ -1493,14 +2192,39 @@ class ElfObjectFile : public ObjectFile {
       info->start_address = vmaddr;
     }
 
-    ReadElfArchMode(file_data(), &info->arch, &info->mode);
+    ReadElfArchMode(input_, &info->arch, &info->mode);
     return true;
   }
 
  private:
+  // The file we read debug info and symbols from, which is usually this one.
+  const ElfInput& debug_input() const {
+    if (&debug_file() == this) {
+      return input_;
+    }
+    if (!debug_input_) {
+      debug_input_.reset(new ElfInput(debug_file().file_data()));
+    }
+    return *debug_input_;
+  }
+
+  // Debug sections may need decompressing, so we only find them once and
+  // share them between all the data sources that read DWARF.
+  const dwarf::File& dwarf() const {
+    if (!dwarf_) {
+      dwarf_.reset(new dwarf::File);
+      ReadDWARFSections(debug_input(), dwarf_.get());
+    }
+    return *dwarf_;
+  }
+
+  ElfInput input_;
+  mutable std::unique_ptr<ElfInput> debug_input_;
+  mutable std::unique_ptr<dwarf::File> dwarf_;
   std::optional<std::vector<bloaty_link_map::Symbol>> link_map_symbols_ = std::nullopt;
   std::optional<std::vector<bloaty_link_map::Section>> link_map_sections_ = std::nullopt;
   mutable std::unordered_map<std::string, std::string> symbol_to_crate_ = {};
+  mutable std::optional<std::vector<DisassemblyReference>> references_;
 };
 
 }  // namespace
@@ -1517,6 +2241,22 @@ std::unique_ptr<ObjectFile> TryOpenELFFile(std::unique_ptr<InputFile>& file,
   } else {
     return nullptr;
   }
+}
+
+void ReadELFDWARFSections(const InputFile& file, dwarf::File* dwarf) {
+  ElfInput input(file);
+  if (!input.elf()) {
+    THROWF("expected an ELF file, not an archive: $0", file.filename());
+  }
+  ReadDWARFSections(input, dwarf);
+}
+
+bool ProbeELFBuildId(int fd, uint64_t file_size, std::string* build_id) {
+  try {
+    return ElfFile::ProbeBuildId(fd, file_size, build_id);
+  } catch (const bloaty::Error&) {
+    return false;
+  }
 
   // A few functions that have been defined but are not yet used.
   (void)&ElfFile::FindSectionByName;
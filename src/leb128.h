@@ -0,0 +1,210 @@
+// Copyright 2021 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// LEB128 decoding, shared by the DWARF and WebAssembly readers.
+//
+// LEB128 stores an integer in 7-bit groups, least significant first, with the
+// high bit of each byte set on every byte but the last.  Most values in
+// practice are one or two bytes, so those are decoded byte by byte.  Longer
+// values are decoded from a single 8-byte load: the position of the first
+// byte with its high bit clear gives the length, and the 7-bit groups are then
+// compacted with PEXT (when compiled for BMI2) or a few shifts and masks.
+//
+// None of these functions throw; they return false on malformed input so that
+// callers can report errors in terms of their own format.
+
+#ifndef BLOATY_LEB128_H_
+#define BLOATY_LEB128_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+#include "absl/strings/string_view.h"
+
+namespace bloaty {
+namespace leb128 {
+
+// We stop at 10 bytes, which is enough for any 64-bit value.
+constexpr size_t kMaxBytes = 10;
+
+namespace internal {
+
+constexpr uint64_t kContinuationBits = 0x8080808080808080ULL;
+
+inline uint64_t LoadLittleEndian64(const char* p) {
+  uint64_t ret;
+  memcpy(&ret, p, sizeof(ret));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  ret = __builtin_bswap64(ret);
+#endif
+  return ret;
+}
+
+// Packs the low 7 bits of each byte of |word| together.
+inline uint64_t CompactGroups(uint64_t word) {
+#ifdef __BMI2__
+  return _pext_u64(word, 0x7f7f7f7f7f7f7f7fULL);
+#else
+  uint64_t x = word & 0x7f7f7f7f7f7f7f7fULL;
+  x = ((x & 0x7f007f007f007f00ULL) >> 1) | (x & 0x007f007f007f007fULL);
+  x = ((x & 0x3fff00003fff0000ULL) >> 2) | (x & 0x00003fff00003fffULL);
+  x = ((x & 0x0fffffff00000000ULL) >> 4) | (x & 0x000000000fffffffULL);
+  return x;
+#endif
+}
+
+// The simple byte-at-a-time decoder, used near the end of the data and for
+// values longer than 8 bytes.
+inline bool DecodeSlow(bool is_signed, int bits, absl::string_view* data,
+                       uint64_t* value) {
+  uint64_t ret = 0;
+  size_t limit = std::min(data->size(), kMaxBytes);
+
+  for (size_t i = 0; i < limit; i++) {
+    uint8_t byte = (*data)[i];
+    ret |= static_cast<uint64_t>(byte & 0x7f) << (7 * i);
+    if ((byte & 0x80) == 0) {
+      int shift = 7 * (i + 1);
+      if (is_signed && shift < bits && (byte & 0x40)) {
+        ret |= -(1ULL << shift);
+      }
+      data->remove_prefix(i + 1);
+      *value = ret;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+}  // namespace internal
+
+// Decodes the LEB128 value at the start of |data| and advances past it.  For
+// signed values, |bits| is the width of the integer being decoded: the value
+// is sign-extended when it has fewer than |bits| bits.  Returns false, leaving
+// |data| unchanged, if the value does not end within kMaxBytes or within
+// |data|.
+inline bool Decode(bool is_signed, int bits, absl::string_view* data,
+                   uint64_t* value) {
+  const char* p = data->data();
+  size_t size = data->size();
+  size_t len;
+  uint64_t ret;
+
+  if (size >= 1 && (p[0] & 0x80) == 0) {
+    len = 1;
+    ret = static_cast<uint8_t>(p[0]);
+  } else if (size >= 2 && (p[1] & 0x80) == 0) {
+    len = 2;
+    ret = (p[0] & 0x7f) | (static_cast<uint64_t>(static_cast<uint8_t>(p[1]))
+                           << 7);
+  } else if (size >= 8) {
+    uint64_t word = internal::LoadLittleEndian64(p);
+    uint64_t ends = ~word & internal::kContinuationBits;
+    if (ends == 0) {
+      return internal::DecodeSlow(is_signed, bits, data, value);
+    }
+    len = (__builtin_ctzll(ends) >> 3) + 1;
+    if (len < 8) {
+      word &= (1ULL << (len * 8)) - 1;
+    }
+    ret = internal::CompactGroups(word);
+  } else {
+    return internal::DecodeSlow(is_signed, bits, data, value);
+  }
+
+  int shift = 7 * len;
+  if (is_signed && shift < bits && (p[len - 1] & 0x40)) {
+    ret |= -(1ULL << shift);
+  }
+  data->remove_prefix(len);
+  *value = ret;
+  return true;
+}
+
+// Advances past one LEB128 value.  Returns false, leaving |data| unchanged,
+// under the same conditions as Decode().
+inline bool Skip(absl::string_view* data) {
+  const char* p = data->data();
+  size_t size = data->size();
+
+  if (size >= 8) {
+    uint64_t ends = ~internal::LoadLittleEndian64(p) &
+                    internal::kContinuationBits;
+    if (ends) {
+      data->remove_prefix((__builtin_ctzll(ends) >> 3) + 1);
+      return true;
+    }
+  }
+
+  size_t limit = std::min(size, kMaxBytes);
+  for (size_t i = 0; i < limit; i++) {
+    if ((p[i] & 0x80) == 0) {
+      data->remove_prefix(i + 1);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Advances past |count| consecutive LEB128 values, eight bytes at a time.
+// Unlike Skip(), this does not limit the length of each value.  Returns
+// false, leaving |data| unchanged, if |data| ends first.
+inline bool SkipMany(size_t count, absl::string_view* data) {
+  const char* p = data->data();
+  const char* end = p + data->size();
+
+  while (count > 0 && end - p >= 8) {
+    uint64_t ends = ~internal::LoadLittleEndian64(p) &
+                    internal::kContinuationBits;
+    size_t found = __builtin_popcountll(ends);
+    if (found < count) {
+      count -= found;
+      p += 8;
+    } else {
+      // Drop the ends of the values before the last one we want.
+      for (size_t i = 1; i < count; i++) {
+        ends &= ends - 1;
+      }
+      p += (__builtin_ctzll(ends) >> 3) + 1;
+      count = 0;
+    }
+  }
+
+  for (; count > 0 && p < end; p++) {
+    if ((*p & 0x80) == 0) {
+      count--;
+    }
+  }
+
+  if (count > 0) {
+    return false;
+  }
+
+  data->remove_prefix(p - data->data());
+  return true;
+}
+
+}  // namespace leb128
+}  // namespace bloaty
+
+#endif  // BLOATY_LEB128_H_
@@ -455,12 +455,11 @@ void ParseSymbolsFromSymbolTable(const LoadCommand& cmd, SymbolTable* table,
 
     if (sink->data_source() >= DataSource::kSymbols) {
       sink->AddVMRange("macho_symbols", sym->n_value, RangeSink::kUnknownSize,
-                       ItaniumDemangle(name, sink->data_source()));
+                       ItaniumDemangle(name, sink->demangle_source()));
     }
 
     if (table) {
-      table->insert(std::make_pair(
-          name, std::make_pair(sym->n_value, RangeSink::kUnknownSize)));
+      table->Insert(name, sym->n_value, RangeSink::kUnknownSize);
     }
 
     // Capture the trailing NULL.
@@ -561,6 +560,16 @@ void ReadDebugSectionsFromSegment(LoadCommand cmd, dwarf::File* dwarf) {
       dwarf->debug_pubtypes = contents;
     } else if (sectname == "__debug_ranges") {
       dwarf->debug_ranges = contents;
+    } else if (sectname == "__debug_str_offs") {
+      dwarf->debug_str_offsets = contents;
+    } else if (sectname == "__debug_line_str") {
+      dwarf->debug_line_str = contents;
+    } else if (sectname == "__debug_addr") {
+      dwarf->debug_addr = contents;
+    } else if (sectname == "__debug_rnglists") {
+      dwarf->debug_rnglists = contents;
+    } else if (sectname == "__debug_loclists") {
+      dwarf->debug_loclists = contents;
     }
   }
 }
@@ -624,10 +633,15 @@ class MachOObjectFile : public ObjectFile {
                                 DataSource::kRawSymbols,
                                 &sinks[0]->MapAtIndex(0));
           symbol_sink.AddOutput(&symbol_map, &empty_munger);
-          ParseSymbols(debug_file().file_data().data(), &symtab, &symbol_sink);
+          // Only the DIEs that fast mode skips are looked up in the symbols.
+          if (sink->options().dwarf_mode() != Options::DWARF_MODE_FAST) {
+            ParseSymbols(debug_file().file_data().data(), &symtab,
+                         &symbol_sink);
+          }
           dwarf::File dwarf;
           ReadDebugSectionsFromMachO(debug_file().file_data(), &dwarf);
-          ReadDWARFCompileUnits(dwarf, symtab, symbol_map, sink);
+          ReadDWARFCompileUnits(dwarf, split_dwarf(), symtab, symbol_map,
+                                sink);
           ParseSymbols(sink->input_file().data(), nullptr, sink);
           break;
         }
@@ -0,0 +1,157 @@
+// Copyright 2021 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A table of symbol name -> (address, size), which the compileunits data
+// source probes for every DIE with a linkage name, and disassembly uses to
+// find a function.
+//
+// Large binaries have millions of symbols, so this is a flat hash table with
+// open addressing (linear probing) rather than a tree.  The entries live in
+// one array in insertion order, and the slots hold indexes into it, so a
+// probe only touches 4 bytes per slot until it finds an entry with the same
+// hash.  The names are not copied: they must outlive the table, as they do
+// when they point into the input file.
+
+#ifndef BLOATY_SYMBOL_TABLE_H_
+#define BLOATY_SYMBOL_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+
+namespace bloaty {
+
+class SymbolTable {
+ public:
+  struct Entry {
+    absl::string_view name;
+    uint64_t hash;
+    uint64_t addr;
+    uint64_t size;
+  };
+
+  size_t size() const { return entries_.size(); }
+
+  // Makes room for |count| entries in total without growing again.  Repeated
+  // calls (one per archive member, say) still grow geometrically.
+  void Reserve(size_t count) {
+    if (count > entries_.capacity()) {
+      entries_.reserve(std::max(count, entries_.capacity() * 2));
+    }
+    GrowSlots(count);
+  }
+
+  // Adds |name| unless it is already in the table, in which case the first
+  // address and size for the name are kept.  Returns whether it was added.
+  bool Insert(absl::string_view name, uint64_t addr, uint64_t size) {
+    GrowSlots(entries_.size() + 1);
+    uint64_t hash = Hash(name);
+    size_t slot = FindSlot(name, hash);
+    if (slots_[slot] != kEmpty) {
+      return false;
+    }
+    slots_[slot] = entries_.size();
+    entries_.push_back(Entry{name, hash, addr, size});
+    return true;
+  }
+
+  // Returns the entry for |name|, or null if there isn't one.
+  const Entry* Find(absl::string_view name) const {
+    if (slots_.empty()) {
+      return nullptr;
+    }
+    uint32_t index = slots_[FindSlot(name, Hash(name))];
+    return index == kEmpty ? nullptr : &entries_[index];
+  }
+
+  // A 64-bit hash that reads the name eight bytes at a time, since symbol
+  // names (especially mangled C++ names) are often long.
+  static uint64_t Hash(absl::string_view name) {
+    const uint64_t kMul = 0x9ddfea08eb382d69ULL;
+    const char* p = name.data();
+    size_t n = name.size();
+    uint64_t h = n * kMul;
+    for (; n >= 8; p += 8, n -= 8) {
+      uint64_t word;
+      memcpy(&word, p, 8);
+      h = Mix(h ^ word, kMul);
+    }
+    if (n > 0) {
+      uint64_t word = 0;
+      memcpy(&word, p, n);
+      h = Mix(h ^ word, kMul);
+    }
+    return Mix(h, kMul);
+  }
+
+ private:
+  static constexpr uint32_t kEmpty = UINT32_MAX;
+  static constexpr size_t kMinCapacity = 16;
+
+  static uint64_t Mix(uint64_t h, uint64_t mul) {
+    h *= mul;
+    return h ^ (h >> 47);
+  }
+
+  // Rehashes into more slots if |count| entries would fill more than half of
+  // them.
+  void GrowSlots(size_t count) {
+    size_t capacity = slots_.empty() ? kMinCapacity : slots_.size();
+    while (count > capacity / 2) {
+      capacity *= 2;
+    }
+    if (capacity != slots_.size()) {
+      Rehash(capacity);
+    }
+  }
+
+  // Returns the slot that holds |name|, or the empty slot where it would go.
+  size_t FindSlot(absl::string_view name, uint64_t hash) const {
+    size_t mask = slots_.size() - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+      uint32_t index = slots_[slot];
+      if (index == kEmpty) {
+        return slot;
+      }
+      const Entry& entry = entries_[index];
+      if (entry.hash == hash && entry.name == name) {
+        return slot;
+      }
+    }
+  }
+
+  void Rehash(size_t capacity) {
+    slots_.assign(capacity, kEmpty);
+    size_t mask = capacity - 1;
+    for (uint32_t i = 0; i < entries_.size(); i++) {
+      size_t slot = entries_[i].hash & mask;
+      while (slots_[slot] != kEmpty) {
+        slot = (slot + 1) & mask;
+      }
+      slots_[slot] = i;
+    }
+  }
+
+  std::vector<Entry> entries_;
+  std::vector<uint32_t> slots_;  // Capacity is a power of two.
+};
+
+}  // namespace bloaty
+
+#endif  // BLOATY_SYMBOL_TABLE_H_
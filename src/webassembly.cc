@@ -15,6 +15,7 @@
 #include "bloaty.h"
 
 #include "absl/strings/substitute.h"
+#include "leb128.h"
 
 ABSL_ATTRIBUTE_NORETURN
 static void Throw(const char *str, int line) {
@@ -42,26 +43,11 @@ T ReadMemcpy(string_view* data) {
 }
 
 uint64_t ReadLEB128Internal(bool is_signed, size_t size, string_view* data) {
-  uint64_t ret = 0;
-  int shift = 0;
-  int maxshift = 70;
-  const char* ptr = data->data();
-  const char* limit = ptr + data->size();
-
-  while (ptr < limit && shift < maxshift) {
-    char byte = *(ptr++);
-    ret |= static_cast<uint64_t>(byte & 0x7f) << shift;
-    shift += 7;
-    if ((byte & 0x80) == 0) {
-      data->remove_prefix(ptr - data->data());
-      if (is_signed && shift < size && (byte & 0x40)) {
-        ret |= -(1ULL << shift);
-      }
-      return ret;
-    }
+  uint64_t ret;
+  if (!leb128::Decode(is_signed, size, data, &ret)) {
+    THROW("corrupt wasm data, unterminated LEB128");
   }
-
-  THROW("corrupt wasm data, unterminated LEB128");
+  return ret;
 }
 
 bool ReadVarUInt1(string_view* data) {
@@ -316,7 +302,7 @@ void ReadCodeSection(const Section& section, const FuncNames& names,
       std::string name = "func[" + std::to_string(i) + "]";
       sink->AddFileRange("wasm_function", name, func);
     } else {
-      sink->AddFileRange("wasm_function", ItaniumDemangle(iter->second, sink->data_source()), func);
+      sink->AddFileRange("wasm_function", ItaniumDemangle(iter->second, sink->demangle_source()), func);
     }
   }
 }
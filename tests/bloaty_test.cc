@@ -14,6 +14,11 @@
 
 #include "test.h"
 
+#include <chrono>
+#include <thread>
+
+#include "absl/strings/str_cat.h"
+
 TEST_F(BloatyTest, EmptyObjectFile) {
   std::string file = "01-empty.o";
   uint64_t size;
@@ -288,7 +293,429 @@ TEST_F(BloatyTest, DiffMode) {
   });
 }
 
+TEST_F(BloatyTest, DeferDemangle) {
+  bloaty::OutputOptions csv;
+  csv.output_format = bloaty::OutputFormat::kCSV;
+  for (const char* mode : {"short", "full"}) {
+    std::vector<std::string> args = {"bloaty", "-d", "sections,symbols",
+                                     "-C", mode, "05-binary.bin",
+                                     "--", "04-simple.so"};
+    RunBloaty(args);
+    std::ostringstream eager;
+    output_->Print(csv, &eager);
+
+    args.push_back("--defer-demangle");
+    RunBloaty(args);
+    std::ostringstream deferred;
+    output_->Print(csv, &deferred);
+    EXPECT_EQ(eager.str(), deferred.str());
+  }
+}
+
+#if defined(BLOATY_HAVE_ZLIB) || defined(BLOATY_HAVE_ZSTD)
+TEST_F(BloatyTest, CompressedDebugSections) {
+  // These are 05-binary.bin with its debug sections compressed in different
+  // ways.  Only file sizes should differ.
+  std::vector<std::string> files;
+#ifdef BLOATY_HAVE_ZLIB
+  files.push_back("08-binary-compressed-debug.bin");
+  files.push_back("12-binary-gnu-compressed-debug.bin");  // .zdebug_*
+#endif
+#ifdef BLOATY_HAVE_ZSTD
+  files.push_back("11-binary-zstd-debug.bin");
+#endif
+  auto vm_sizes = [this]() {
+    std::map<std::string, uint64_t> ret;
+    for (const auto& child : top_row_->sorted_children) {
+      if (child.vmsize > 0) ret[child.name] = child.vmsize;
+    }
+    return ret;
+  };
+  for (const char* source : {"compileunits", "inlines"}) {
+    RunBloaty({"bloaty", "-d", source, "-n", "0", "05-binary.bin"});
+    auto expected = vm_sizes();
+    for (const auto& file : files) {
+      RunBloaty({"bloaty", "-d", source, "-n", "0", file});
+      EXPECT_EQ(expected, vm_sizes()) << file;
+    }
+  }
+}
+#endif
+
+#ifdef BLOATY_HAVE_ZSTD
+TEST_F(BloatyTest, CorruptCompressedDebugSection) {
+  // The .debug_info header claims an enormous uncompressed size, but the data
+  // (which doesn't record its own size) decompresses to only 100 bytes.  This
+  // must be an error, not an attempt to allocate the claimed size.
+  AssertBloatyFails({"bloaty", "-d", "compileunits",
+                     "13-binary-corrupt-compressed-debug.bin"},
+                    "corrupt zstd data");
+}
+#endif
+
+TEST_F(BloatyTest, DWARF5) {
+  // 09-binary-dwarf5.bin links the objects of 05-binary.bin, built with DWARF
+  // 5 debug info.
+  std::string file = "09-binary-dwarf5.bin";
+
+  RunBloaty({"bloaty", "-d", "compileunits,symbols", file});
+  auto row = FindRow("bar.o.c");
+  ASSERT_TRUE(row != nullptr);
+  AssertChildren(*row, {
+    std::make_tuple("bar_x", 4000, kSameAsVM),
+    std::make_tuple("bar_func", kUnknown, kSameAsVM),
+    std::make_tuple("bar_y", kUnknown, kSameAsVM),
+    std::make_tuple("bar_z", kUnknown, kSameAsVM),
+  });
+
+  row = FindRow("foo.o.c");
+  ASSERT_TRUE(row != nullptr);
+  AssertChildren(*row, {
+    std::make_tuple("foo_x", 4000, 0),
+    std::make_tuple("foo_func", kUnknown, kSameAsVM),
+    std::make_tuple("foo_y", kUnknown, kSameAsVM),
+  });
+
+  // The v5 line table header names the files.
+  RunBloaty({"bloaty", "-d", "inlines", "-n", "0", file});
+  EXPECT_TRUE(FindRow("bar.o.c:5") != nullptr);
+  EXPECT_TRUE(FindRow("foo.o.c:4") != nullptr);
+  EXPECT_TRUE(FindRow("main.o.c:1") != nullptr);
+}
+
+TEST_F(BloatyTest, DWARFSectionsByUnit) {
+  RunBloaty({"bloaty", "-d", "compileunits,sections", "-n", "0",
+             "05-binary.bin"});
+  auto section_size = [this](const std::string& unit,
+                             const std::string& section) -> uint64_t {
+    const bloaty::RollupRow* row = FindRow(unit);
+    if (!row) return 0;
+    for (const auto& child : row->sorted_children) {
+      if (child.name == section) return child.filesize;
+    }
+    return 0;
+  };
+
+  // Each unit owns exactly its own abbreviation table, which starts at the
+  // unit's abbrev offset (see readelf --debug-dump=abbrev).  Together they
+  // cover the whole section.
+  EXPECT_EQ(101, section_size("foo.o.c", ".debug_abbrev"));
+  EXPECT_EQ(101, section_size("bar.o.c", ".debug_abbrev"));
+  EXPECT_EQ(55, section_size("main.o.c", ".debug_abbrev"));
+
+  // Strings referenced from a unit's top-level DIE, like its DW_AT_name, go
+  // to that unit rather than to a unit with no name.
+  for (const auto& child : top_row_->sorted_children) {
+    EXPECT_NE("", child.name);
+  }
+  EXPECT_GE(section_size("main.o.c", ".debug_str"), strlen("main.o.c") + 1);
+}
+
+TEST_F(BloatyTest, FastDWARFMode) {
+  // --dwarf-mode=fast finds code through .debug_aranges and divides the
+  // .debug_* sections at unit boundaries, so these match the full mode.  What
+  // it gives up is data like bar_x, which only DIEs describe, and the
+  // .debug_str strings that only those DIEs refer to.
+  auto unit_sections = [this](const std::string& unit) {
+    std::map<std::string, std::pair<uint64_t, uint64_t>> ret;
+    const bloaty::RollupRow* row = FindRow(unit);
+    if (row) {
+      for (const auto& child : row->sorted_children) {
+        ret[child.name] = std::make_pair(child.vmsize, child.filesize);
+      }
+    }
+    return ret;
+  };
+
+  RunBloaty({"bloaty", "-d", "compileunits,sections", "-n", "0",
+             "05-binary.bin"});
+  auto full = unit_sections("bar.o.c");
+  RunBloaty({"bloaty", "-d", "compileunits,sections", "-n", "0",
+             "--dwarf-mode=fast", "05-binary.bin"});
+  auto fast = unit_sections("bar.o.c");
+
+  for (const char* section :
+       {".text", ".debug_info", ".debug_abbrev", ".debug_line"}) {
+    EXPECT_EQ(full[section], fast[section]) << section;
+  }
+  EXPECT_GE(full[".data"].first, 4000);
+  EXPECT_EQ(0, fast.count(".data"));
+  EXPECT_LT(fast[".debug_str"].second, full[".debug_str"].second);
+}
+
+TEST_F(BloatyTest, SkipDiscardedFunction) {
+  // unused_func was discarded by --gc-sections, so its DIE has low_pc == 0
+  // and we skip its children.  The DIE after them is the only one that
+  // describes sibling_table, so skipping must stop right before it.  The
+  // second file has no DW_AT_sibling, so the children are decoded rather than
+  // jumped over; either way their strings must not be attributed to gc.c.
+  std::vector<uint64_t> debug_str_sizes;
+  for (const char* file : {"14-binary-gc-sections.bin",
+                           "15-binary-gc-sections-no-sibling.bin"}) {
+    RunBloaty({"bloaty", "-d", "compileunits,sections", "-n", "0", file});
+    const bloaty::RollupRow* row = FindRow("gc.c");
+    ASSERT_TRUE(row != nullptr);
+    uint64_t data_vmsize = 0;
+    uint64_t debug_str_filesize = 0;
+    for (const auto& child : row->sorted_children) {
+      if (child.name == ".data") data_vmsize = child.vmsize;
+      if (child.name == ".debug_str") debug_str_filesize = child.filesize;
+    }
+    EXPECT_GE(data_vmsize, 4000) << file;
+    EXPECT_GT(debug_str_filesize, 0) << file;
+    debug_str_sizes.push_back(debug_str_filesize);
+  }
+  EXPECT_EQ(debug_str_sizes[0], debug_str_sizes[1]);
+}
+
+TEST_F(BloatyTest, DisassemblyRefs) {
+  // Only x86-64 code addresses data relative to RIP, which is how references
+  // are found.
+  std::ifstream file("05-binary.bin", std::ios::binary);
+  char ident[5] = {};
+  ASSERT_TRUE(file.read(ident, sizeof(ident)));
+  if (ident[4] != 2 /* ELFCLASS64 */) {
+    return;
+  }
+
+  auto has_row = [this](const std::string& name) {
+    for (const auto& child : top_row_->sorted_children) {
+      if (child.name == name) return true;
+    }
+    return false;
+  };
+
+  // __libc_csu_init takes the addresses of .init_array and .fini_array, which
+  // no symbol covers, so by default they are attributed to it.
+  RunBloaty({"bloaty", "-d", "symbols", "-n", "0", "05-binary.bin"});
+  const bloaty::RollupRow* row = FindRow("__libc_csu_init");
+  ASSERT_TRUE(row != nullptr);
+  uint64_t vmsize = row->vmsize;
+  EXPECT_FALSE(has_row("[section .init_array]"));
+  EXPECT_FALSE(has_row("[section .fini_array]"));
+
+  RunBloaty({"bloaty", "-d", "symbols", "-n", "0", "--no-disassembly-refs",
+             "05-binary.bin"});
+  row = FindRow("__libc_csu_init");
+  ASSERT_TRUE(row != nullptr);
+  EXPECT_GE(vmsize, row->vmsize + 16);
+  EXPECT_TRUE(has_row("[section .init_array]"));
+  EXPECT_TRUE(has_row("[section .fini_array]"));
+}
+
 TEST_F(BloatyTest, SeparateDebug) {
   RunBloaty({"bloaty", "--debug-file=05-binary.bin", "07-binary-stripped.bin",
              "-d", "symbols"});
 }
+
+TEST_F(BloatyTest, DebugFileDir) {
+  bloaty::OutputOptions csv;
+  csv.output_format = bloaty::OutputFormat::kCSV;
+  RunBloaty({"bloaty", "--debug-file=05-binary.bin", "07-binary-stripped.bin",
+             "-d", "symbols"});
+  std::ostringstream expected;
+  output_->Print(csv, &expected);
+
+  // The current directory also has 05-binary.bin and unrelated files.
+  RunBloaty({"bloaty", "--debug-file-dir=.", "07-binary-stripped.bin", "-d",
+             "symbols"});
+  std::ostringstream actual;
+  output_->Print(csv, &actual);
+  EXPECT_EQ(expected.str(), actual.str());
+}
+
+TEST_F(BloatyTest, SplitDWARF) {
+  // 10-binary-split-dwarf.bin is 09-binary-dwarf5.bin built with
+  // -gsplit-dwarf, so its units should find the same code and data once we
+  // have their .dwo files.
+  RunBloaty({"bloaty", "-d", "compileunits", "09-binary-dwarf5.bin"});
+  const bloaty::RollupRow* row = FindRow("bar.o.c");
+  ASSERT_TRUE(row != nullptr);
+  uint64_t bar_vmsize = row->vmsize;
+  EXPECT_GT(bar_vmsize, 4000);
+
+  // Without them, the skeleton units don't even have names.
+  RunBloaty({"bloaty", "-d", "compileunits", "10-binary-split-dwarf.bin"});
+  EXPECT_TRUE(FindRow("[DWARF is missing filename]") != nullptr);
+
+  // The split units can come from a package or from a directory of .dwo
+  // files.  16-binary-split-dwarf4.bin is the same again with DWARF 4, where
+  // the DWO ID is a DW_AT_GNU_dwo_id attribute and GNU dwp writes a version 2
+  // package index.
+  std::vector<std::vector<std::string>> runs = {
+      {"--dwp=10-binary-split-dwarf.dwp", "10-binary-split-dwarf.bin"},
+      {"--dwo-dir=10-binary-split-dwarf-dwo", "10-binary-split-dwarf.bin"},
+      {"--dwp=16-binary-split-dwarf4.dwp", "16-binary-split-dwarf4.bin"},
+      {"--dwo-dir=16-binary-split-dwarf4-dwo", "16-binary-split-dwarf4.bin"},
+  };
+  for (const auto& run : runs) {
+    RunBloaty({"bloaty", "-d", "compileunits", run[0], run[1]});
+    row = FindRow("bar.o.c");
+    ASSERT_TRUE(row != nullptr) << run[0];
+    EXPECT_EQ(bar_vmsize, row->vmsize) << run[0];
+    EXPECT_TRUE(FindRow("foo.o.c") != nullptr) << run[0];
+  }
+
+  // One index of the split units serves every binary.
+  RunBloaty({"bloaty", "-d", "compileunits",
+             "--dwp=10-binary-split-dwarf.dwp", "10-binary-split-dwarf.bin",
+             "10-binary-split-dwarf.bin"});
+  row = FindRow("bar.o.c");
+  ASSERT_TRUE(row != nullptr);
+  EXPECT_EQ(bar_vmsize * 2, row->vmsize);
+}
+
+TEST_F(BloatyTest, SplitDWARFLists) {
+  // The .dwo file of this optimized build has location and range lists of its
+  // own.  The split DIEs' offsets into those must not be taken as offsets into
+  // the binary's lists, so the unit gets no more of the binary's lists than
+  // its skeleton does, which is all that fast mode reads.
+  auto unit_lists = [this]() {
+    std::map<std::string, uint64_t> ret;
+    const bloaty::RollupRow* row = FindRow("opt.c");
+    if (row) {
+      for (const auto& child : row->sorted_children) {
+        if (child.name == ".debug_rnglists" ||
+            child.name == ".debug_loclists") {
+          ret[child.name] = child.filesize;
+        }
+      }
+    }
+    return ret;
+  };
+
+  std::vector<std::string> args = {
+      "bloaty", "-d", "compileunits,sections", "-n", "0",
+      "--dwo-dir=17-binary-split-dwarf-O2-dwo", "17-binary-split-dwarf-O2.bin"};
+  RunBloaty(args);
+  auto full = unit_lists();
+  const bloaty::RollupRow* row = FindRow("opt.c");
+  ASSERT_TRUE(row != nullptr);
+  EXPECT_GE(row->vmsize, 4000);
+
+  args.push_back("--dwarf-mode=fast");
+  RunBloaty(args);
+  EXPECT_EQ(unit_lists(), full);
+}
+
+TEST(NameMungerTest, FirstMatchingRegexWins) {
+  bloaty::NameMunger munger;
+  EXPECT_TRUE(munger.IsEmpty());
+  EXPECT_EQ("foo::bar", munger.Munge("foo::bar"));
+
+  munger.AddRegex("^baz", "BAZ");
+  munger.AddRegex("(\\w+)::", "ns:\\1");
+  munger.AddRegex("bar", "BAR");
+  munger.AddRegex("(", "invalid");
+  munger.AddRegex("^q", "\\3");
+  munger.AddRegex("quux", "QUUX");
+  EXPECT_FALSE(munger.IsEmpty());
+
+  EXPECT_EQ("ns:foo", munger.Munge("foo::bar"));
+  EXPECT_EQ("BAR", munger.Munge("xbarx"));
+  EXPECT_EQ("BAZ", munger.Munge("baz::bar"));
+  // The rewrite for "^q" is invalid, so it falls through to the next match.
+  EXPECT_EQ("QUUX", munger.Munge("quux"));
+  EXPECT_EQ("nomatch", munger.Munge("nomatch"));
+  // Memoized results are the same.
+  EXPECT_EQ("ns:foo", munger.Munge("foo::bar"));
+
+  // The cache keeps its own copy of the name, not the caller's.
+  std::string name = "abc::def";
+  EXPECT_EQ("ns:abc", munger.Munge(name));
+  name = "ybary";
+  EXPECT_EQ("BAR", munger.Munge(name));
+  EXPECT_EQ("ns:abc", munger.Munge("abc::def"));
+}
+
+// Mangled names of varying length and nesting, with a few plain C names mixed
+// in, so that demangling them takes a realistic and uneven amount of work.
+static std::vector<std::string> SyntheticSymbols(size_t count) {
+  std::vector<std::string> ret;
+  ret.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    std::string func = "func" + std::to_string(i);
+    switch (i % 4) {
+      case 0:
+        ret.push_back("c_function_" + std::to_string(i));
+        break;
+      case 1:
+        ret.push_back(absl::StrCat("_ZN6bloaty", func.size(), func, "Ev"));
+        break;
+      case 2:
+        ret.push_back(absl::StrCat("_ZN6bloaty3ns", i % 7, func.size(), func,
+                                   "EPKcm"));
+        break;
+      default:
+        ret.push_back(absl::StrCat("_ZNK6bloaty8RangeMap", func.size(), func,
+                                   "IN4absl11string_viewEEEvRKSt6vectorIT_"
+                                   "SaIS5_EE"));
+        break;
+    }
+  }
+  return ret;
+}
+
+TEST(ItaniumDemangleAllTest, MatchesItaniumDemangle) {
+  // Several chunks' worth, ending in a partial chunk.
+  std::vector<std::string> symbols = SyntheticSymbols(3 * 1024 + 7);
+  std::vector<absl::string_view> views(symbols.begin(), symbols.end());
+
+  for (auto source : {bloaty::DataSource::kShortSymbols,
+                      bloaty::DataSource::kFullSymbols,
+                      bloaty::DataSource::kRawSymbols}) {
+    std::vector<std::string> demangled =
+        bloaty::ItaniumDemangleAll(views, source);
+    ASSERT_EQ(symbols.size(), demangled.size());
+    for (size_t i = 0; i < symbols.size(); i++) {
+      ASSERT_EQ(bloaty::ItaniumDemangle(symbols[i], source), demangled[i])
+          << i;
+    }
+  }
+
+  EXPECT_TRUE(bloaty::ItaniumDemangleAll({}, bloaty::DataSource::kShortSymbols)
+                  .empty());
+}
+
+// Not run by default; use:
+//   bloaty_test --gtest_also_run_disabled_tests --gtest_filter=*Benchmark
+TEST(ItaniumDemangleAllTest, DISABLED_Benchmark) {
+  std::vector<std::string> symbols = SyntheticSymbols(1000000);
+  std::vector<absl::string_view> views(symbols.begin(), symbols.end());
+  const auto source = bloaty::DataSource::kFullSymbols;
+
+  // Best of a few runs, so the first run's page faults don't count.
+  auto bench = [](const std::function<std::vector<std::string>()>& demangle,
+                  std::vector<std::string>* result) {
+    std::chrono::duration<double, std::milli> best{};
+    for (int rep = 0; rep < 3; rep++) {
+      auto start = std::chrono::steady_clock::now();
+      *result = demangle();
+      std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - start;
+      if (rep == 0 || elapsed < best) best = elapsed;
+    }
+    return best.count();
+  };
+
+  // ItaniumDemangleAll() on one thread is this loop.
+  std::vector<std::string> sequential;
+  double one_thread = bench([&views, source]() {
+    std::vector<std::string> ret(views.size());
+    for (size_t i = 0; i < views.size(); i++) {
+      ret[i] = bloaty::ItaniumDemangle(views[i], source);
+    }
+    return ret;
+  }, &sequential);
+
+  std::vector<std::string> parallel;
+  double all_threads = bench([&views, source]() {
+    return bloaty::ItaniumDemangleAll(views, source);
+  }, &parallel);
+
+  EXPECT_EQ(sequential, parallel);
+  printf("1 thread:   %.1f ms\n", one_thread);
+  printf("%u threads: %.1f ms (%.2fx)\n",
+         std::max(1u, std::thread::hardware_concurrency()), all_threads,
+         one_thread / all_threads);
+}
@@ -0,0 +1,256 @@
+// Copyright 2021 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "leb128.h"
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace bloaty {
+namespace leb128 {
+namespace {
+
+// The byte-at-a-time decoder that the DWARF and WebAssembly readers used to
+// have, which the fast paths must agree with.
+bool ReferenceDecode(bool is_signed, int bits, absl::string_view* data,
+                     uint64_t* value) {
+  uint64_t ret = 0;
+  int shift = 0;
+  int maxshift = 70;
+  const char* ptr = data->data();
+  const char* limit = ptr + data->size();
+
+  while (ptr < limit && shift < maxshift) {
+    char byte = *(ptr++);
+    ret |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    shift += 7;
+    if ((byte & 0x80) == 0) {
+      data->remove_prefix(ptr - data->data());
+      if (is_signed && shift < bits && (byte & 0x40)) {
+        ret |= -(1ULL << shift);
+      }
+      *value = ret;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+std::string EncodeUnsigned(uint64_t val) {
+  std::string ret;
+  do {
+    uint8_t byte = val & 0x7f;
+    val >>= 7;
+    if (val) byte |= 0x80;
+    ret.push_back(byte);
+  } while (val);
+  return ret;
+}
+
+std::string EncodeSigned(int64_t val) {
+  std::string ret;
+  while (true) {
+    uint8_t byte = val & 0x7f;
+    val >>= 7;
+    if ((val == 0 && !(byte & 0x40)) || (val == -1 && (byte & 0x40))) {
+      ret.push_back(byte);
+      return ret;
+    }
+    ret.push_back(byte | 0x80);
+  }
+}
+
+std::vector<uint64_t> InterestingValues() {
+  std::vector<uint64_t> ret;
+  for (int i = 0; i < 64; i++) {
+    uint64_t bit = 1ULL << i;
+    ret.push_back(bit - 1);
+    ret.push_back(bit);
+    ret.push_back(bit + 1);
+    ret.push_back(~bit);
+  }
+  ret.push_back(UINT64_MAX);
+  return ret;
+}
+
+// Checks Decode() and Skip() on |encoded| followed by up to 9 bytes of
+// trailing data, so that we cover both the word-at-a-time and tail paths.
+void CheckDecodes(const std::string& encoded, bool is_signed, uint64_t expected) {
+  for (size_t trailing = 0; trailing < 10; trailing++) {
+    std::string buf = encoded + std::string(trailing, '\xff');
+    absl::string_view data(buf);
+    uint64_t value;
+    ASSERT_TRUE(Decode(is_signed, 64, &data, &value));
+    EXPECT_EQ(expected, value);
+    EXPECT_EQ(trailing, data.size());
+
+    data = buf;
+    ASSERT_TRUE(Skip(&data));
+    EXPECT_EQ(trailing, data.size());
+  }
+}
+
+TEST(LEB128Test, Unsigned) {
+  for (uint64_t val : InterestingValues()) {
+    CheckDecodes(EncodeUnsigned(val), false, val);
+  }
+}
+
+TEST(LEB128Test, Signed) {
+  for (uint64_t val : InterestingValues()) {
+    CheckDecodes(EncodeSigned(val), true, val);
+  }
+}
+
+TEST(LEB128Test, NarrowSignedValues) {
+  // A one-byte varint7 of -1 is 0x7f; with |bits| of 7 it is not extended.
+  absl::string_view data("\x7f");
+  uint64_t value;
+  ASSERT_TRUE(Decode(true, 7, &data, &value));
+  EXPECT_EQ(0x7fu, value);
+
+  data = "\x7f";
+  ASSERT_TRUE(Decode(true, 32, &data, &value));
+  EXPECT_EQ(UINT64_MAX, value);
+}
+
+TEST(LEB128Test, Malformed) {
+  const std::string unterminated(20, '\x80');
+  for (size_t len = 0; len <= unterminated.size(); len++) {
+    absl::string_view data(unterminated.data(), len);
+    uint64_t value;
+    EXPECT_FALSE(Decode(false, 64, &data, &value));
+    EXPECT_FALSE(Skip(&data));
+    EXPECT_FALSE(SkipMany(1, &data));
+    EXPECT_EQ(len, data.size());
+  }
+
+  // Eleven bytes is too long, even though it is terminated.
+  std::string too_long = std::string(10, '\x80') + '\x01';
+  absl::string_view data(too_long);
+  uint64_t value;
+  EXPECT_FALSE(Decode(false, 64, &data, &value));
+  EXPECT_FALSE(Skip(&data));
+  EXPECT_EQ(too_long.size(), data.size());
+}
+
+TEST(LEB128Test, MatchesReferenceOnRandomData) {
+  std::mt19937 rng(1234);
+  std::string buf(1 << 16, '\0');
+  for (char& ch : buf) {
+    // Mostly continuation bytes, so that we see values of every length.
+    uint8_t byte = rng();
+    ch = (rng() % 4) ? (byte | 0x80) : (byte & 0x7f);
+  }
+
+  const std::pair<bool, int> kModes[] = {
+      {false, 64}, {true, 64}, {false, 32}, {true, 32}, {true, 7}};
+
+  for (size_t i = 0; i < buf.size(); i++) {
+    for (const auto& mode : kModes) {
+      absl::string_view expected_data = absl::string_view(buf).substr(i);
+      absl::string_view data = expected_data;
+      uint64_t expected = 0;
+      uint64_t value = 0;
+      bool ok = ReferenceDecode(mode.first, mode.second, &expected_data,
+                                &expected);
+      ASSERT_EQ(ok, Decode(mode.first, mode.second, &data, &value)) << i;
+      ASSERT_EQ(expected_data.size(), data.size()) << i;
+      ASSERT_EQ(expected, value) << i;
+
+      data = absl::string_view(buf).substr(i);
+      ASSERT_EQ(ok, Skip(&data)) << i;
+      ASSERT_EQ(expected_data.size(), data.size()) << i;
+    }
+  }
+}
+
+TEST(LEB128Test, SkipMany) {
+  std::mt19937_64 rng(5678);
+  std::string buf;
+  std::vector<size_t> ends;
+  for (int i = 0; i < 1000; i++) {
+    buf += EncodeUnsigned(rng() >> (rng() % 64));
+    ends.push_back(buf.size());
+  }
+
+  for (size_t start = 0; start < 20; start++) {
+    size_t begin = start ? ends[start - 1] : 0;
+    for (size_t count = 0; start + count <= ends.size(); count += 1 + count / 4) {
+      absl::string_view data = absl::string_view(buf).substr(begin);
+      ASSERT_TRUE(SkipMany(count, &data));
+      size_t end = count ? ends[start + count - 1] : begin;
+      ASSERT_EQ(buf.size() - end, data.size()) << start << " " << count;
+    }
+  }
+
+  absl::string_view data(buf);
+  EXPECT_FALSE(SkipMany(ends.size() + 1, &data));
+  EXPECT_EQ(buf.size(), data.size());
+}
+
+// Not run by default; use:
+//   leb128_test --gtest_also_run_disabled_tests --gtest_filter=*Benchmark
+TEST(LEB128Test, DISABLED_Benchmark) {
+  // Roughly the mix of lengths in .debug_info and line programs: mostly one
+  // and two byte values, with a tail of longer ones.
+  std::mt19937_64 rng(42);
+  std::string buf;
+  const size_t kValues = 1 << 22;
+  for (size_t i = 0; i < kValues; i++) {
+    int r = rng() % 100;
+    int bits = r < 70 ? 7 : r < 90 ? 14 : r < 98 ? 28 : 64;
+    buf += EncodeUnsigned(rng() & (bits == 64 ? UINT64_MAX : (1ULL << bits) - 1));
+  }
+
+  auto bench = [&](const char* name, bool (*decode)(bool, int,
+                                                    absl::string_view*,
+                                                    uint64_t*)) {
+    uint64_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int rep = 0; rep < 10; rep++) {
+      absl::string_view data(buf);
+      uint64_t value;
+      while (decode(false, 64, &data, &value)) {
+        sum += value;
+      }
+    }
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    printf("%-10s %.2f ns/value (checksum %" PRIx64 ")\n", name,
+           elapsed.count() / (kValues * 10), sum);
+  };
+
+  bench("reference", ReferenceDecode);
+  bench("Decode", Decode);
+
+  auto start = std::chrono::steady_clock::now();
+  for (int rep = 0; rep < 10; rep++) {
+    absl::string_view data(buf);
+    ASSERT_TRUE(SkipMany(kValues, &data));
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  printf("%-10s %.2f ns/value\n", "SkipMany", elapsed.count() / (kValues * 10));
+}
+
+}  // namespace
+}  // namespace leb128
+}  // namespace bloaty
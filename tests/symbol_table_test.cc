@@ -0,0 +1,129 @@
+// Copyright 2021 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "symbol_table.h"
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace bloaty {
+namespace {
+
+TEST(SymbolTableTest, Empty) {
+  SymbolTable table;
+  EXPECT_EQ(0, table.size());
+  EXPECT_TRUE(table.Find("foo") == nullptr);
+  EXPECT_TRUE(table.Find("") == nullptr);
+}
+
+TEST(SymbolTableTest, FirstInsertWins) {
+  SymbolTable table;
+  EXPECT_TRUE(table.Insert("foo", 0x1000, 16));
+  EXPECT_TRUE(table.Insert("bar", 0x2000, 32));
+  EXPECT_FALSE(table.Insert("foo", 0x3000, 48));
+  EXPECT_EQ(2, table.size());
+
+  const SymbolTable::Entry* entry = table.Find("foo");
+  ASSERT_TRUE(entry != nullptr);
+  EXPECT_EQ("foo", entry->name);
+  EXPECT_EQ(0x1000, entry->addr);
+  EXPECT_EQ(16, entry->size);
+
+  entry = table.Find("bar");
+  ASSERT_TRUE(entry != nullptr);
+  EXPECT_EQ(0x2000, entry->addr);
+
+  EXPECT_TRUE(table.Find("fo") == nullptr);
+  EXPECT_TRUE(table.Find("foo2") == nullptr);
+}
+
+TEST(SymbolTableTest, NamesThatDifferLate) {
+  // Mangled names often share long prefixes, and only differ in the tail
+  // that the hash reads last.
+  std::string prefix = "_ZN5bloaty5dwarf10DIEReader";
+  std::vector<std::string> names;
+  for (int len = 0; len < 20; len++) {
+    names.push_back(prefix + std::string(len, 'x'));
+    names.push_back(prefix + std::string(len, 'x') + '\0');
+  }
+
+  SymbolTable table;
+  for (size_t i = 0; i < names.size(); i++) {
+    EXPECT_TRUE(table.Insert(names[i], i, 1));
+  }
+  for (size_t i = 0; i < names.size(); i++) {
+    const SymbolTable::Entry* entry = table.Find(names[i]);
+    ASSERT_TRUE(entry != nullptr) << i;
+    EXPECT_EQ(i, entry->addr);
+  }
+}
+
+TEST(SymbolTableTest, MatchesStdMap) {
+  std::mt19937 rng(1234);
+  std::vector<std::string> names;
+  for (int i = 0; i < 100000; i++) {
+    std::string name(rng() % 40, '\0');
+    for (char& ch : name) {
+      ch = 'a' + rng() % 4;
+    }
+    names.push_back(name);
+  }
+
+  SymbolTable table;
+  std::map<std::string, uint64_t> expected;
+  table.Reserve(names.size() / 2);
+  for (size_t i = 0; i < names.size(); i++) {
+    bool inserted = expected.emplace(names[i], i).second;
+    EXPECT_EQ(inserted, table.Insert(names[i], i, 0));
+  }
+  EXPECT_EQ(expected.size(), table.size());
+
+  for (const auto& pair : expected) {
+    const SymbolTable::Entry* entry = table.Find(pair.first);
+    ASSERT_TRUE(entry != nullptr);
+    EXPECT_EQ(pair.second, entry->addr);
+  }
+  EXPECT_TRUE(table.Find("zzz") == nullptr);
+}
+
+TEST(SymbolTableTest, ManyInsertsWithoutReserve) {
+  // Mach-O symbol tables are filled without Reserve(), so Insert() alone must
+  // grow geometrically.  Growing by one entry at a time took about a minute
+  // for 100k names; this should take milliseconds.
+  std::vector<std::string> names;
+  for (int i = 0; i < 1000000; i++) {
+    names.push_back("_ZN5bloaty6symbolE" + std::to_string(i));
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  SymbolTable table;
+  for (size_t i = 0; i < names.size(); i++) {
+    EXPECT_TRUE(table.Insert(names[i], i, 1));
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  EXPECT_EQ(names.size(), table.size());
+  EXPECT_LT(elapsed, std::chrono::seconds(10));
+  const SymbolTable::Entry* entry = table.Find("_ZN5bloaty6symbolE123456");
+  ASSERT_TRUE(entry != nullptr);
+  EXPECT_EQ(123456, entry->addr);
+}
+
+}  // namespace
+}  // namespace bloaty
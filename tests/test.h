@@ -15,13 +15,16 @@
 #ifndef BLOATY_TESTS_TEST_H_
 #define BLOATY_TESTS_TEST_H_
 
+#include <cstring>
 #include <fstream>
+#include <map>
 #include <memory>
 #include <string>
 #include <unordered_set>
 #include <tuple>
 #include <vector>
 #include "absl/strings/numbers.h"
+#include "absl/strings/str_join.h"
 #include "absl/strings/str_split.h"
 #include "gmock/gmock.h"
 #include "google/protobuf/text_format.h"
@@ -133,6 +136,85 @@ class BloatyTest : public ::testing::Test {
     }
   }
 
+  // Decodes the columnar output and checks that it holds the same rows as the
+  // TSV output.
+  void CheckColumnarConsistency() {
+    std::ostringstream stream;
+    bloaty::OutputOptions options;
+    options.output_format = bloaty::OutputFormat::kTSV;
+    output_->Print(options, &stream);
+    std::vector<std::string> tsv_rows = absl::StrSplit(stream.str(), '\n');
+    tsv_rows.pop_back();
+
+    stream.str("");
+    options.output_format = bloaty::OutputFormat::kColumnar;
+    output_->Print(options, &stream);
+    std::string data = stream.str();
+    size_t pos = 0;
+    auto read = [&](size_t size) {
+      EXPECT_LE(pos + size, data.size());
+      const char* ret = data.data() + pos;
+      pos += (size + 7) & ~7;
+      return ret;
+    };
+    auto read64 = [&]() {
+      uint64_t val;
+      memcpy(&val, read(8), 8);
+      return val;
+    };
+
+    ASSERT_EQ(std::string("BLOATYC\0", 8), std::string(read(8), 8));
+    uint32_t header[2];
+    memcpy(header, read(8), 8);
+    ASSERT_EQ(1, header[0]);
+    ASSERT_EQ(output_->diff_mode(), header[1] & 1);
+    uint64_t row_count = read64();
+    uint64_t column_count = read64();
+    ASSERT_EQ(tsv_rows.size() - 1, row_count);
+    ASSERT_EQ(output_->source_names().size(), column_count);
+
+    std::vector<std::vector<std::string>> rows(row_count);
+    std::vector<std::string> names;
+    for (uint64_t i = 0; i < column_count; i++) {
+      uint64_t name_len = read64();
+      names.emplace_back(read(name_len), name_len);
+      uint64_t dict_size = read64();
+      std::vector<uint64_t> offsets(dict_size + 1);
+      memcpy(offsets.data(), read(offsets.size() * 8), offsets.size() * 8);
+      const char* strings = read(offsets.back());
+      std::vector<uint32_t> index(row_count);
+      memcpy(index.data(), read(row_count * 4), row_count * 4);
+      for (uint64_t j = 0; j < row_count; j++) {
+        ASSERT_LT(index[j], dict_size);
+        rows[j].emplace_back(strings + offsets[index[j]],
+                             offsets[index[j] + 1] - offsets[index[j]]);
+      }
+    }
+    names.push_back("vmsize");
+    names.push_back("filesize");
+    ASSERT_EQ(tsv_rows[0], absl::StrJoin(names, "\t"));
+
+    int num_size_columns = output_->diff_mode() ? 4 : 2;
+    std::vector<std::vector<int64_t>> sizes(num_size_columns);
+    for (auto& column : sizes) {
+      column.resize(row_count);
+      memcpy(column.data(), read(row_count * 8), row_count * 8);
+    }
+    ASSERT_EQ(data.size(), pos);
+
+    for (uint64_t j = 0; j < row_count; j++) {
+      rows[j].push_back(std::to_string(sizes[0][j]));
+      rows[j].push_back(std::to_string(sizes[1][j]));
+      ASSERT_EQ(tsv_rows[j + 1], absl::StrJoin(rows[j], "\t"));
+      if (output_->diff_mode()) {
+        ASSERT_GE(sizes[2][j], 0);
+        ASSERT_GE(sizes[3][j], 0);
+        ASSERT_GE(sizes[2][j] + sizes[0][j], 0);
+        ASSERT_GE(sizes[3][j] + sizes[1][j], 0);
+      }
+    }
+  }
+
   void CheckConsistency(const bloaty::Options& options) {
     ASSERT_EQ(options.base_filename_size() > 0, output_->diff_mode());
 
@@ -149,6 +231,7 @@ class BloatyTest : public ::testing::Test {
     int rows = 0;
     CheckConsistencyForRow(*top_row_, true, output_->diff_mode(), &rows);
     CheckCSVConsistency(rows);
+    CheckColumnarConsistency();
     ASSERT_EQ("TOTAL", top_row_->name);
   }
 
@@ -118,3 +118,174 @@ make_ar "06-diff.a" "foo2.o" "bar.o" "a_filename_longer_than_sixteen_chars.o"
 cp "05-binary.bin" "07-binary-stripped.bin"
 strip "07-binary-stripped.bin"
 publish "07-binary-stripped.bin"
+
+cp "05-binary.bin" "08-binary-compressed-debug.bin"
+objcopy --compress-debug-sections=zlib "08-binary-compressed-debug.bin"
+publish "08-binary-compressed-debug.bin"
+
+# 05-binary.bin with DWARF 5 debug info.  The objects are built in a
+# subdirectory so that their source files keep the same names, and we link
+# without the C runtime so that only our own objects contribute DWARF.
+
+mkdir dwarf5
+for f in foo bar main; do
+  (cd dwarf5 && cp ../$f.o.c . && $CC -g -gdwarf-5 -fPIC -o $f.o -c $f.o.c)
+done
+
+make_binary "09-binary-dwarf5.bin" -nostdlib -Wl,-e,main \
+  dwarf5/foo.o dwarf5/bar.o dwarf5/main.o
+
+# 09-binary-dwarf5.bin again, but with -gsplit-dwarf, so that most of the
+# DWARF is in .dwo files that we combine into a package.  GNU dwp doesn't
+# understand DWARF 5, so we use llvm-dwp.
+
+DWP="${DWP:-llvm-dwp}"
+
+mkdir split
+for f in foo bar main; do
+  (cd split && cp ../$f.o.c . &&
+   $CC -g -gdwarf-5 -gsplit-dwarf -fPIC -o $f.o -c $f.o.c)
+done
+
+make_binary "10-binary-split-dwarf.bin" -nostdlib -Wl,-e,main \
+  split/foo.o split/bar.o split/main.o
+$DWP -o "10-binary-split-dwarf.dwp" split/foo.dwo split/bar.dwo split/main.dwo
+publish "10-binary-split-dwarf.dwp"
+
+# The same .dwo files, unpackaged, for --dwo-dir.
+mkdir -p "$OUTPUT_DIR/10-binary-split-dwarf-dwo"
+cp split/foo.dwo split/bar.dwo split/main.dwo \
+  "$OUTPUT_DIR/10-binary-split-dwarf-dwo"
+
+# 05-binary.bin with its debug sections compressed with zstd, and with the
+# older GNU convention of ".zdebug_*" sections.
+
+cp "05-binary.bin" "11-binary-zstd-debug.bin"
+objcopy --compress-debug-sections=zstd "11-binary-zstd-debug.bin"
+publish "11-binary-zstd-debug.bin"
+
+cp "05-binary.bin" "12-binary-gnu-compressed-debug.bin"
+objcopy --compress-debug-sections=zlib-gnu "12-binary-gnu-compressed-debug.bin"
+publish "12-binary-gnu-compressed-debug.bin"
+
+# 11-binary-zstd-debug.bin with a corrupt .debug_info.  Its header claims an
+# enormous uncompressed size, and its data is a zstd frame that doesn't record
+# its size and holds only 100 zero bytes (one RLE block), followed by a
+# skippable frame that pads out the rest of the section.
+
+function le32() {
+  printf '\\x%02x\\x%02x\\x%02x\\x%02x' $(($1 & 255)) $(($1 >> 8 & 255)) \
+    $(($1 >> 16 & 255)) $(($1 >> 24 & 255))
+}
+
+FILE="13-binary-corrupt-compressed-debug.bin"
+cp "11-binary-zstd-debug.bin" $FILE
+read OFFSET SIZE <<< `readelf -SW $FILE |
+  awk '{ for (i = 1; i < NF; i++) if ($i == ".debug_info") print $(i+3), $(i+4) }'`
+OFFSET=$((16#$OFFSET))
+SIZE=$((16#$SIZE))
+if readelf -h $FILE | grep -q ELF64; then
+  # ch_type = ELFCOMPRESS_ZSTD, ch_reserved, ch_size = 2^62.
+  CHDR="$(le32 2)$(le32 0)$(le32 0)$(le32 0x40000000)"
+  CHDR_SIZE=24
+else
+  # ch_type = ELFCOMPRESS_ZSTD, ch_size = 2^32 - 1.
+  CHDR="$(le32 2)$(le32 0xffffffff)"
+  CHDR_SIZE=12
+fi
+FRAME='\x28\xb5\x2f\xfd\x00\x00\x23\x03\x00\x00'
+SKIPPABLE="$(le32 0x184d2a50)$(le32 $((SIZE - CHDR_SIZE - 10 - 8)))"
+printf "$CHDR" | dd of=$FILE bs=1 seek=$OFFSET conv=notrunc status=none
+printf "$FRAME$SKIPPABLE" |
+  dd of=$FILE bs=1 seek=$((OFFSET + CHDR_SIZE)) conv=notrunc status=none
+publish $FILE
+
+# A function discarded by --gc-sections, whose DIE is left with low_pc == 0
+# and children that bloaty skips.  gcc emits functions in reverse order, so the
+# DIE after it is sibling_func's, and only that DIE describes sibling_table.
+# The second binary renames DW_AT_sibling in the abbreviations (keeping the
+# form, so the DIEs are unchanged), which forces bloaty to decode the skipped
+# children instead of jumping over them.
+
+cat > gc.c <<'GC_EOF'
+int sibling_func(void) {
+  static int sibling_table[1000] = {1};
+  return sibling_table[0];
+}
+
+int unused_func(int a) {
+  int local = a * 2;
+  return local + 1;
+}
+
+int main(void) { return sibling_func(); }
+GC_EOF
+
+$CC -g -gdwarf-4 -fPIC -ffunction-sections -c gc.c -o gc.o
+make_binary "14-binary-gc-sections.bin" -nostdlib -Wl,-e,main \
+  -Wl,--gc-sections gc.o
+
+$CC -g -gdwarf-4 -fPIC -ffunction-sections -dA -S gc.c -o gc-no-sibling.s
+sed -i 's/\.uleb128 0x1\t# (DW_AT_sibling)/.uleb128 0x1d\t# (DW_AT_containing_type)/' \
+  gc-no-sibling.s
+$CC -c gc-no-sibling.s -o gc-no-sibling.o
+make_binary "15-binary-gc-sections-no-sibling.bin" -nostdlib -Wl,-e,main \
+  -Wl,--gc-sections gc-no-sibling.o
+
+# Split DWARF as it was before DWARF 5: the skeleton units have a
+# DW_AT_GNU_dwo_id, and GNU dwp writes a version 2 package index.
+
+GNU_DWP="${GNU_DWP:-dwp}"
+
+mkdir split4
+for f in foo bar main; do
+  (cd split4 && cp ../$f.o.c . &&
+   $CC -g -gdwarf-4 -gsplit-dwarf -fPIC -o $f.o -c $f.o.c)
+done
+
+make_binary "16-binary-split-dwarf4.bin" -nostdlib -Wl,-e,main \
+  split4/foo.o split4/bar.o split4/main.o
+$GNU_DWP -o "16-binary-split-dwarf4.dwp" \
+  split4/foo.dwo split4/bar.dwo split4/main.dwo
+publish "16-binary-split-dwarf4.dwp"
+mkdir -p "$OUTPUT_DIR/16-binary-split-dwarf4-dwo"
+cp split4/foo.dwo split4/bar.dwo split4/main.dwo \
+  "$OUTPUT_DIR/16-binary-split-dwarf4-dwo"
+
+# Split DWARF from an optimized build, whose .dwo files have location and
+# range lists of their own (.debug_loclists.dwo and .debug_rnglists.dwo).
+
+mkdir split_opt
+cat > split_opt/opt.c <<'OPT_EOF'
+int opt_table[1000] = {1};
+
+static int __attribute__((noinline)) opt_scale(int x) {
+  return x * opt_table[x & 7];
+}
+
+static inline int opt_step(int x, int i) {
+  if (x > i) {
+    return opt_scale(x - i);
+  }
+  return x + opt_table[i & 15];
+}
+
+int opt_func(int n) {
+  int sum = 0;
+  for (int i = 0; i < n; i++) {
+    sum += opt_step(sum, i);
+    if (__builtin_expect(sum == 12345, 0)) {
+      sum += opt_scale(sum);
+    }
+  }
+  return sum;
+}
+
+int main(void) { return opt_func(opt_table[0]); }
+OPT_EOF
+
+(cd split_opt && $CC -O2 -g -gdwarf-5 -gsplit-dwarf -fPIC -o opt.o -c opt.c)
+make_binary "17-binary-split-dwarf-O2.bin" -nostdlib -Wl,-e,main \
+  split_opt/opt.o
+mkdir -p "$OUTPUT_DIR/17-binary-split-dwarf-O2-dwo"
+cp split_opt/opt.dwo "$OUTPUT_DIR/17-binary-split-dwarf-O2-dwo"